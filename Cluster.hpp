@@ -5,118 +5,1251 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <ClusterBase.hpp>
+#include <Graph.hpp>
+#include <KnowledgeStore.hpp>
+#include <Options.hpp>
+#include <Scheduler.hpp>
 #include <Stats.hpp>
+#include <Traffic.hpp>
 
-struct KnownInfoConnection {
-	double latency;
+struct Conn : public ConnBase {
+	using ConnBase::ConnBase;
+
+	ExpAvg latency;
+	WindowedMin min_rtt{MIN_RTT_WINDOW};
+	P2Quantile tail_rtt{.99};
+	// RTT samples of the peer are its heartbeats, either answers to probes
+	// or echoes that come with other messages.
+	ArrivalWindow arrivals;
+	// Smoothed deviation of RTT samples from the estimate and the number
+	// of samples in a row it has been steady.
+	double rtt_deviation = 0;
+	size_t steady_count = 0;
+	// Heartbeat probing interval and the time of the next probe.
+	size_t heartbeat_interval = HEARTBEAT_INTERVAL;
+	size_t heartbeat_deadline = 0;
+	size_t bytes_sent = 0;
+	size_t bytes_recv = 0;
+	// Time an outgoing connection was accepted, by the peer's clock.
+	size_t time_accepted = 0;
+	// Plumtree: origins whose updates the peer gets only announcements
+	// of, it is eager for all of them on a new connection.
+	std::unordered_set<NodeId> lazy_origins;
 };
 
-struct KnownInfoNode {
-	std::unordered_map<NodeId, KnownInfoConnection> conns;
-	size_t info_version;
+// Plumtree: an announced info that has not arrived yet.
+struct MissingInfo {
+	size_t stamp;
+	// Peers that announced it, in order of arrival.
+	std::deque<NodeId> announcers;
 };
 
-struct Conn : public ConnBase {
-	using ConnBase::ConnBase;
+// Heartbeat timestamps that travel with other messages: the sending time
+// and the sending time of peer's message being answered, shifted by the
+// time it was held, 0 if none.
+struct Piggyback {
+	size_t time_sent = Scheduler::now();
+	size_t echo_time = 0;
+};
 
-	ExpAvg latency;
+// Known infos of a node, each info counts the nodes that hold it.
+class KnownInfos : public KnownInfoMap {
+public:
+	KnownInfos() = default;
+	KnownInfos(KnownInfos&& m) noexcept = default;
+	// Swap, the previous content is released by @a m.
+	KnownInfos& operator=(KnownInfos&& m) noexcept;
+	~KnownInfos() noexcept;
+};
+
+// The last topology think of a node: the knowledge, the number of
+// connections and the options it was made with, its urgency and whether
+// it found no better topology. The same think would get the same.
+struct TopologyMemo {
+	uint64_t knowledge_hash = 0;
+	size_t conn_count = SIZE_MAX;
+	size_t options_version = 0;
+	double urgency = 0;
+	bool is_idle = false;
 };
 
+// Latencies the last topology think has read with latency_estimate coords:
+// the own coordinate, the least latency predicted by it and the measured
+// ones. A prediction moves no more than the coordinate does.
+struct TopologyLatencies {
+	NetCoord coord;
+	double min_predicted = std::numeric_limits<double>::infinity();
+	std::unordered_map<NodeId, double> measured;
+};
+
+// Connections a node that knows @a known_count alive nodes aims at.
+inline size_t
+optimalConnCount(size_t known_count)
+{
+	if (Options::membership == MEMBERSHIP_PARTIAL)
+		return std::min(ACTIVE_VIEW_SIZE, known_count - 1);
+	double base = known_count + INITIAL_CONNECT_COUNT;
+	size_t count = size_t(CONN_COEF * std::pow(base, .5) + .5);
+	if (count < INITIAL_CONNECT_COUNT)
+		count = INITIAL_CONNECT_COUNT;
+	if (count > known_count - 1)
+		count = known_count - 1;
+	return count;
+}
+
 struct Node : public NodeBase<Conn> {
 	using NodeBase<Conn>::NodeBase;
 
 	size_t self_info_version = 0;
-	std::unordered_map<NodeId, KnownInfoNode> known_nodes;
+	// Own info must be reissued even if it hasn't changed.
+	bool self_info_dirty = true;
+	// Said farewell and waits for removal, does nothing on its own.
+	bool leaving = false;
+	KnownInfos known_nodes;
 	std::unordered_map<NodeId, ExpAvg> known_direct_latency;
+	// Own network coordinate, moved by heartbeat RTT samples.
+	NetCoord coord;
+	TrafficCounters sent_traffic;
+	TrafficCounters recv_traffic;
+	// XOR of hashes of (origin, stamp) of known nodes by buckets
+	// of DIGEST_BUCKET_SIZE consecutive node ids.
+	std::unordered_map<size_t, uint64_t> digest_buckets;
+	// XOR of all of them, changes with any known info.
+	uint64_t knowledge_hash = 0;
+	// Tombstones in known_nodes in order of arrival (that is roughly the
+	// order of dead_time): pairs of origin and stamp.
+	std::deque<std::pair<NodeId, size_t>> tombstones;
+	size_t dead_count = 0;
+	// Stamps and eviction times of evicted tombstones by origin: infos of
+	// the origin up to them may still be in circulation and must not bring
+	// it back. They are kept for another TOMBSTONE_TTL, in order of
+	// eviction.
+	std::unordered_map<NodeId, std::pair<size_t, size_t>> forgotten;
+	std::deque<std::pair<NodeId, size_t>> forgotten_order;
+	// Partial view membership: known nodes that are not connected.
+	std::vector<NodeId> passive_view;
+	size_t last_cross_dc_gossip = 0;
+	// Stamps of infos sent to each DC by DC summaries while this node is
+	// its bridge, the next summary carries only what has changed.
+	std::unordered_map<NodeId, size_t> dc_summary_sent[NUM_DC];
+	// Ids of alive known nodes of own DC that have peers in each DC.
+	std::set<size_t> bridge_candidates[NUM_DC];
+	TopologyMemo topology_memo;
+	TopologyLatencies topology_latencies;
+	// Time of the last rejection of a connection by node, topology thinks
+	// don't try to connect to it for ADMISSION_BACKOFF.
+	std::unordered_map<NodeId, size_t> rejected_time;
+	// Locally issued infos to broadcast on the next round.
+	std::vector<KnownInfoRef> plumtree_outbox;
+	// Announcements for lazy peers: pairs of origin and stamp.
+	std::unordered_map<NodeId, std::vector<std::pair<NodeId, size_t>>>
+		ihave_queue;
+	std::unordered_map<NodeId, MissingInfo> missing_infos;
+	size_t gossip_round = 0;
+	// Adaptive gossip cadence: current interval, time of the last round
+	// and whether anything has changed since it.
+	size_t gossip_interval = GOSSIP_INTERVAL;
+	size_t last_gossip = 0;
+	bool knowledge_changed = true;
+	// Time of the last RTT sample by peer.
+	std::unordered_map<NodeId, size_t> last_rtt_time;
+	// Piggybacked timestamps of peers to echo: time the message was sent
+	// by peer and time it has arrived.
+	std::unordered_map<NodeId, std::pair<size_t, size_t>> echo_pending;
 
-	const std::unordered_map<NodeId, KnownInfoNode>& prepageKnowledge();
-	void applyKnowledge(const std::unordered_map<NodeId, KnownInfoNode>& m);
+	// Reissue own info if peers or their latencies have changed.
+	const KnownInfoMap& prepageKnowledge();
+	void applyKnowledge(const std::vector<uint8_t>& payload);
+	// Return false if the info was rejected.
+	bool setKnownInfo(KnownInfoRef&& info);
+	// Known infos or connections have changed.
+	void noteChange() { knowledge_changed = true; }
+	// Apply an RTT sample to all the connections to @a peer_id.
+	void updateRtt(NodeId peer_id, double rtt);
+	// Remember in topology_latencies the latencies a think reads, in
+	// coords mode only.
+	void memoLatencies();
+	// Forget topology_memo in coords mode if a latency it was made with
+	// has moved beyond Options::latency_threshold: the measured one of
+	// @a peer_id or, if it is unset, the predicted ones.
+	void noteLatencyChange(NodeId peer_id = NodeId());
+	// Suspicion level of @a peer_id failure by the least of connections.
+	double getPhi(NodeId peer_id) const;
+	// Timestamps to piggyback on a message to @a peer_id.
+	Piggyback makePiggyback(NodeId peer_id);
+	// Take timestamps that came with a message from @a peer_id, the
+	// @a transfer_time of the message is not a part of RTT.
+	void takePiggyback(NodeId peer_id, const Piggyback& piggyback,
+			   size_t transfer_time);
+	// Issue a death certificate of a known node.
+	void markDead(NodeId node_id);
+	// Accept a death certificate and forget the node, return false if
+	// it's not new.
+	bool setTombstone(KnownInfoRef&& tombstone);
+	// Forget nodes that are dead for TOMBSTONE_TTL.
+	void evictTombstones();
+	// Whether info @a stamp of @a origin is older than its evicted
+	// tombstone.
+	bool isForgotten(NodeId origin, size_t stamp) const;
+	void addPassive(NodeId node_id);
+	void removePassive(NodeId node_id);
+	// Forget infos of nodes out of peers, their peers and passive view.
+	void prunePartialKnowledge();
+	// Own info and infos of peers.
+	void getNeighborhood(std::vector<const KnownInfoNode *>& res) const;
+	size_t getAliveKnownCount() const { return known_nodes.size() - dead_count; }
+	// Measured latency to @a peer_id, predicted by coordinates if it's
+	// never been probed and that is enabled, or the one of cross DC link.
 	double getKnownLatency(NodeId peer_id) const;
+	// DC of a known node, own DC if it is unknown.
+	size_t getKnownDc(NodeId node_id) const;
+	// Whether this node is elected to gossip to DC @a peer_dc: one of
+	// DC_BRIDGE_COUNT nodes with least ids in own DC that have peers there.
+	// A node that knows fewer such nodes, as with partial membership,
+	// elects itself, so there might be more bridges but never none.
+	bool isDcBridge(size_t peer_dc) const;
+	// Add or remove origin of @a info in bridge_candidates.
+	void updBridgeCandidates(const KnownInfoNode& info, bool is_added);
+	// Sorted pairs of bucket and its hash.
+	void getDigest(std::vector<std::pair<size_t, uint64_t>>& res) const;
+	// Whether a new connection exceeds Options::admission_degree.
+	bool isOverDegree() const;
+	// Partial view membership: whether the active view is full.
+	bool isViewFull() const
+	{
+		return Options::membership == MEMBERSHIP_PARTIAL &&
+		       getConns().size() >= ACTIVE_VIEW_SIZE;
+	}
+	// Own peer to offer to @a node_id instead: the least connected one
+	// @a node_id has no connection to, unset if there's none.
+	NodeId getRedirect(NodeId node_id) const;
+	// Random own peer, connected or not yet, to forward @a node_id to
+	// when the active view is full, unset if there's none.
+	NodeId getForward(NodeId node_id) const;
+	bool isRejecting(NodeId node_id) const;
+	// Forget rejections older than ADMISSION_BACKOFF, return true if any.
+	bool expireRejections();
+
+private:
+	void eraseKnownInfo(KnownInfoMap::iterator itr);
+	// Whether @a conns (pairs of peer and latency) or the coordinate
+	// differ from the own published info, sorts them.
+	bool isSelfInfoChanged(
+		std::vector<std::pair<NodeId, double>>& conns) const;
+	// Mask of DCs of peers in @a conns with gossip_scope dc, 0 otherwise.
+	size_t getDcLinks(
+		const std::vector<std::pair<NodeId, double>>& conns) const;
 
 };
 
 using Cluster = ClusterBase<Node>;
 
+// Delays between creation of infos and their arrival to nodes in origin's
+// DC and in other DCs.
+struct Propagation {
+	static inline SumMax same_dc;
+	static inline SumMax cross_dc;
+	// Number of infos and tombstones issued by nodes.
+	static inline size_t issued_count = 0;
+	// Number of infos received by gossip, including duplicates.
+	static inline size_t copy_count = 0;
+	static inline size_t round_count = 0;
+};
+
+// Connect candidates that topology thinks have evaluated.
+struct TopologyCandidates {
+	static inline size_t evaluated_count = 0;
+	// Thinks that were answered by TopologyMemo.
+	static inline size_t reused_count = 0;
+	// Connects and drops that thinks have decided.
+	static inline size_t move_count = 0;
+};
+
+// Connections rejected by admission and the ones redirected to other peers.
+struct Admission {
+	static inline size_t reject_count = 0;
+	static inline size_t redirect_count = 0;
+};
+
+// Connects to a peer that a node already has a connection to: suppressed
+// before sending anything and handshakes dropped as a duplicate when both
+// sides have connected to each other.
+struct Handshakes {
+	static inline size_t suppressed_count = 0;
+	static inline size_t wasted_count = 0;
+};
+
+// RTT samples of all connections.
+struct LinkLatency {
+	static inline LogHistogram samples;
+};
+
+// Suspicions of the failure detector against the ground truth.
+struct FailureDetection {
+	// Time of deletion of nodes that have failed, graceful leavers are
+	// not there. Kept in order of deletion until TOMBSTONE_TTL later, when
+	// the node is forgotten.
+	static inline std::unordered_map<NodeId, size_t> death_time;
+	static inline std::deque<NodeId> death_order;
+	static inline SumMax detection_time;
+	static inline size_t false_positive_count = 0;
+
+	// @a node_id has failed now.
+	static void noteDeath(NodeId node_id);
+	// A node suspects @a node_id, it is false if that one is alive.
+	static void suspect(NodeId node_id);
+	static void expire();
+};
+
+// Nodes that hold an alive info of an origin, any version, by origin.
+// Together with holder counts of the latest infos that gives the number of
+// outdated ones without scanning all known infos of all nodes.
+struct Staleness {
+	static inline std::unordered_map<NodeId, size_t> holder_count;
+
+	static void addHolder(NodeId origin) { holder_count[origin]++; }
+	static void removeHolder(NodeId origin);
+};
+
+// Times it took info versions to reach CONVERGENCE_LEVELS of nodes.
+struct Convergence {
+	static inline SumMax time[CONVERGENCE_LEVEL_COUNT];
+
+	// @a info has got one more holder.
+	static void update(const KnownInfoNode& info);
+};
+
+// far_node_count of statuses since the latest membership change: the time
+// of the change and pairs of status time and far_node_count.
+struct TopologyConvergence {
+	static inline size_t change_time = 0;
+	static inline std::vector<std::pair<size_t, size_t>> samples;
+
+	// Nodes have been added, deleted or told to leave now.
+	static void noteChange();
+	// Time from the change to the first status within
+	// TOPOLOGY_CONVERGED_SHARE of the least far_node_count since then,
+	// @a far_node_count is of the current status.
+	static size_t update(size_t far_node_count);
+};
+
+KnownInfos&
+KnownInfos::operator=(KnownInfos&& m) noexcept
+{
+	swap(m);
+	return *this;
+}
+
+KnownInfos::~KnownInfos() noexcept
+{
+	for (const auto& [origin, info] : *this) {
+		info->holder_count--;
+		if (!info->dead)
+			Staleness::removeHolder(origin);
+	}
+}
+
+void
+Staleness::removeHolder(NodeId origin)
+{
+	auto itr = holder_count.find(origin);
+	if (--itr->second == 0)
+		holder_count.erase(itr);
+}
+
+void
+FailureDetection::noteDeath(NodeId node_id)
+{
+	expire();
+	death_time[node_id] = Scheduler::now();
+	death_order.push_back(node_id);
+}
+
+void
+FailureDetection::suspect(NodeId node_id)
+{
+	expire();
+	auto itr = death_time.find(node_id);
+	if (itr != death_time.end()) {
+		detection_time.update(Scheduler::now() - itr->second);
+		return;
+	}
+	const Node *node = Cluster::findNode(node_id);
+	if (node != nullptr && !node->leaving)
+		false_positive_count++;
+}
+
+void
+FailureDetection::expire()
+{
+	while (!death_order.empty() &&
+	       death_time.at(death_order.front()) + TOMBSTONE_TTL <=
+	       Scheduler::now()) {
+		death_time.erase(death_order.front());
+		death_order.pop_front();
+	}
+}
+
+void
+Convergence::update(const KnownInfoNode& info)
+{
+	size_t node_count = Cluster::getNodeCount();
+	size_t& level = info.converged_level;
+	while (level < CONVERGENCE_LEVEL_COUNT &&
+	       info.holder_count >= CONVERGENCE_LEVELS[level] * node_count) {
+		time[level].update(Scheduler::now() - info.time_created);
+		level++;
+	}
+}
+
+void
+TopologyConvergence::noteChange()
+{
+	change_time = Scheduler::now();
+	samples.clear();
+}
+
+size_t
+TopologyConvergence::update(size_t far_node_count)
+{
+	samples.emplace_back(Scheduler::now(), far_node_count);
+	size_t least = far_node_count;
+	for (const auto& [time, count] : samples)
+		least = std::min(least, count);
+	double limit = least * (1. + TOPOLOGY_CONVERGED_SHARE);
+	for (const auto& [time, count] : samples)
+		if (count <= limit)
+			return time - change_time;
+	return 0;
+}
+
+inline size_t
+digestBucket(NodeId node_id)
+{
+	return node_id.rawID() / DIGEST_BUCKET_SIZE;
+}
+
+inline uint64_t
+digestHash(NodeId node_id, size_t stamp)
+{
+	uint64_t x = node_id.rawID() * 0x9E3779B97F4A7C15ull + stamp;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
 double Node::getKnownLatency(NodeId peer_id) const
 {
 	auto itr = known_direct_latency.find(peer_id);
 	if (itr != known_direct_latency.end())
 		return itr->second.get();
+	if (Options::latency_estimate == LATENCY_ESTIMATE_COORDS &&
+	    coord.isTrusted()) {
+		auto info = known_nodes.find(peer_id);
+		if (info != known_nodes.end() && !info->second->dead &&
+		    info->second->coord.isTrusted())
+			return coord.distance(info->second->coord);
+	}
 	return 2 * CROSS_DC_LATENCY;
 }
 
-const std::unordered_map<NodeId, KnownInfoNode>& Node::prepageKnowledge()
+void Node::updateRtt(NodeId peer_id, double rtt)
+{
+	if (!hasPeer(peer_id))
+		return;
+	for (ConnId conn_id : getPeerConns(peer_id)) {
+		Conn& conn = getConn(conn_id);
+		if (conn.arrivals.is()) {
+			double dev = std::fabs(rtt - conn.latency.get());
+			conn.rtt_deviation += RTT_DEVIATION_ALPHA *
+					      (dev - conn.rtt_deviation);
+			if (conn.rtt_deviation * 100 <=
+			    rtt * Options::heartbeat_jitter)
+				conn.steady_count++;
+			else
+				conn.steady_count = 0;
+		}
+		conn.latency.update(rtt);
+		conn.min_rtt.update(Scheduler::now(), rtt);
+		conn.tail_rtt.update(rtt);
+		// The first sample comes with the handshake, next heartbeat
+		// is expected after an interval and a round trip.
+		if (!conn.arrivals.is())
+			conn.arrivals.start(Scheduler::now(),
+					    HEARTBEAT_INTERVAL + rtt);
+		else
+			conn.arrivals.update(Scheduler::now());
+	}
+	known_direct_latency[peer_id].update(rtt);
+	LinkLatency::samples.update(rtt);
+	last_rtt_time[peer_id] = Scheduler::now();
+	noteLatencyChange(peer_id);
+}
+
+void Node::memoLatencies()
+{
+	if (Options::latency_estimate != LATENCY_ESTIMATE_COORDS)
+		return;
+	TopologyLatencies& memo = topology_latencies;
+	memo.coord = coord;
+	memo.min_predicted = std::numeric_limits<double>::infinity();
+	memo.measured.clear();
+	for (const auto& [id, latency] : known_direct_latency)
+		memo.measured.emplace(id, latency.get());
+	if (!coord.isTrusted())
+		return;
+	for (const auto& [id, info] : known_nodes) {
+		if (id == getId() || info->dead || !info->coord.isTrusted() ||
+		    known_direct_latency.count(id) != 0)
+			continue;
+		memo.min_predicted = std::min(memo.min_predicted,
+					      coord.distance(info->coord));
+	}
+}
+
+void Node::noteLatencyChange(NodeId peer_id)
+{
+	if (Options::latency_estimate != LATENCY_ESTIMATE_COORDS)
+		return;
+	const TopologyLatencies& memo = topology_latencies;
+	double threshold = Options::latency_threshold / 100.;
+	bool is_moved;
+	if (peer_id.isSet()) {
+		// A node measured first was predicted before.
+		auto itr = memo.measured.find(peer_id);
+		double latency = known_direct_latency.at(peer_id).get();
+		is_moved = itr == memo.measured.end() ||
+			   std::fabs(latency - itr->second) >
+			   itr->second * threshold;
+	} else {
+		is_moved = coord.isTrusted() != memo.coord.isTrusted() ||
+			   coord.moved(memo.coord) >
+			   memo.min_predicted * threshold;
+	}
+	if (is_moved)
+		topology_memo = TopologyMemo{};
+}
+
+double Node::getPhi(NodeId peer_id) const
+{
+	double res = 0;
+	bool first = true;
+	for (ConnId conn_id : getPeerConns(peer_id)) {
+		const Conn& conn = getConn(conn_id);
+		if (!conn.arrivals.is())
+			continue;
+		// A sample is due a probing interval and a round trip after
+		// the previous one at most, the window may still hold shorter
+		// intervals of samples that came with other messages.
+		double min_mean = conn.heartbeat_interval + conn.latency.get();
+		double phi = conn.arrivals.phi(Scheduler::now(), min_mean,
+					       PHI_MIN_STDDEV);
+		if (first || phi < res)
+			res = phi;
+		first = false;
+	}
+	return res;
+}
+
+Piggyback Node::makePiggyback(NodeId peer_id)
+{
+	Piggyback res;
+	auto itr = echo_pending.find(peer_id);
+	if (itr != echo_pending.end()) {
+		auto [time_sent, time_recv] = itr->second;
+		res.echo_time = time_sent + (Scheduler::now() - time_recv);
+		echo_pending.erase(itr);
+	}
+	return res;
+}
+
+void Node::takePiggyback(NodeId peer_id, const Piggyback& piggyback,
+			 size_t transfer_time)
+{
+	if (!hasPeer(peer_id))
+		return;
+	// Time the message would take if it was a bare heartbeat, the echo
+	// counts the transfer of this one as held.
+	size_t arrival = Scheduler::now() - transfer_time;
+	if (piggyback.echo_time != 0)
+		updateRtt(peer_id, arrival - piggyback.echo_time);
+	echo_pending[peer_id] = {piggyback.time_sent, arrival};
+}
+
+bool Node::isOverDegree() const
+{
+	if (Options::admission_degree == 0)
+		return false;
+	// A node that is learning the cluster underestimates the optimum.
+	size_t optimal = std::max(optimalConnCount(getAliveKnownCount()),
+				  INITIAL_CONNECT_COUNT);
+	return getConns().size() * 100 >= optimal * Options::admission_degree;
+}
+
+NodeId Node::getRedirect(NodeId node_id) const
 {
-	KnownInfoNode me;
-	me.info_version = ++self_info_version;
+	auto itr = known_nodes.find(node_id);
+	const KnownInfoNode *info = itr != known_nodes.end() ?
+				    &*itr->second : nullptr;
 	std::vector<NodeId> peers;
-	getPeers(peers);
+	getEstablishedPeers(peers);
+	NodeId res;
+	size_t res_size = SIZE_MAX;
 	for (NodeId peer_id : peers) {
-		if (known_nodes.count(peer_id) == 0)
+		if (peer_id == node_id ||
+		    (info != nullptr && info->hasPeer(peer_id)))
+			continue;
+		auto peer = known_nodes.find(peer_id);
+		if (peer == known_nodes.end() || peer->second->dead)
+			continue;
+		size_t size = peer->second->size();
+		if (size < res_size ||
+		    (size == res_size && peer_id.rawID() < res.rawID())) {
+			res = peer_id;
+			res_size = size;
+		}
+	}
+	return res;
+}
+
+NodeId Node::getForward(NodeId node_id) const
+{
+	std::vector<NodeId> peers;
+	for (const auto& [peer_id, conns] : getPeersRaw())
+		if (peer_id != node_id)
+			peers.push_back(peer_id);
+	if (peers.empty())
+		return NodeId();
+	return peers[Rnd::choose(peers)];
+}
+
+bool Node::isRejecting(NodeId node_id) const
+{
+	auto itr = rejected_time.find(node_id);
+	return itr != rejected_time.end() &&
+	       itr->second + ADMISSION_BACKOFF > Scheduler::now();
+}
+
+bool Node::expireRejections()
+{
+	size_t count = rejected_time.size();
+	for (auto itr = rejected_time.begin(); itr != rejected_time.end(); ) {
+		if (itr->second + ADMISSION_BACKOFF <= Scheduler::now())
+			itr = rejected_time.erase(itr);
+		else
+			++itr;
+	}
+	return rejected_time.size() != count;
+}
+
+size_t Node::getKnownDc(NodeId node_id) const
+{
+	auto itr = known_nodes.find(node_id);
+	if (itr == known_nodes.end() || itr->second->dead)
+		return dc;
+	return itr->second->dc;
+}
+
+bool Node::isDcBridge(size_t peer_dc) const
+{
+	size_t rank = 0;
+	for (size_t id : bridge_candidates[peer_dc]) {
+		if (rank++ == DC_BRIDGE_COUNT)
+			break;
+		if (id == getId().rawID())
+			return true;
+	}
+	return false;
+}
+
+void Node::updBridgeCandidates(const KnownInfoNode& info, bool is_added)
+{
+	if (info.dead || info.dc != dc)
+		return;
+	for (size_t i = 0; i < NUM_DC; i++) {
+		if ((info.dc_links & (size_t{1} << i)) == 0)
 			continue;
+		if (is_added)
+			bridge_candidates[i].insert(info.origin.rawID());
+		else
+			bridge_candidates[i].erase(info.origin.rawID());
+	}
+}
 
-		KnownInfoConnection conn;
-		conn.latency = getKnownLatency(peer_id);
-		me.conns[peer_id] = std::move(conn);
+bool Node::isSelfInfoChanged(
+	std::vector<std::pair<NodeId, double>>& conns) const
+{
+	auto itr = known_nodes.find(getId());
+	if (itr == known_nodes.end())
+		return true;
+	const KnownInfoNode& info = *itr->second;
+	if (info.size() != conns.size() || info.dc_links != getDcLinks(conns))
+		return true;
+	// Coordinates are published only for latency_estimate coords.
+	if (Options::latency_estimate == LATENCY_ESTIMATE_COORDS &&
+	    (info.coord.isTrusted() != coord.isTrusted() ||
+	     coord.moved(info.coord) > COORD_CHANGE_THRESHOLD))
+		return true;
+	std::sort(conns.begin(), conns.end(), [](const auto& a, const auto& b) {
+		return a.first.rawID() < b.first.rawID();
+	});
+	for (size_t i = 0; i < conns.size(); i++) {
+		if (info.peers[i] != conns[i].first)
+			return true;
+		double diff = std::abs(info.latencies[i] - conns[i].second);
+		if (diff * 100 > info.latencies[i] * Options::latency_threshold)
+			return true;
 	}
-	known_nodes[getId()] = std::move(me);
+	return false;
+}
+
+size_t Node::getDcLinks(
+	const std::vector<std::pair<NodeId, double>>& conns) const
+{
+	if (Options::gossip_scope != GOSSIP_SCOPE_DC)
+		return 0;
+	size_t res = 0;
+	for (const auto& [peer_id, latency] : conns)
+		res |= size_t{1} << getKnownDc(peer_id);
+	return res;
+}
+
+const KnownInfoMap& Node::prepageKnowledge()
+{
+	std::vector<std::pair<NodeId, double>> conns;
+	std::vector<NodeId> peers;
+	getPeers(peers);
+	for (NodeId peer_id : peers) {
+		auto itr = known_nodes.find(peer_id);
+		if (itr == known_nodes.end() || itr->second->dead)
+			continue;
+		conns.emplace_back(peer_id, getKnownLatency(peer_id));
+	}
+	if (!self_info_dirty && !isSelfInfoChanged(conns))
+		return known_nodes;
+	self_info_dirty = false;
+	setKnownInfo(KnowledgeStore::intern(getId(), ++self_info_version, dc,
+					    getDcLinks(conns), coord, conns));
+	Propagation::issued_count++;
+	if (Options::usePlumtree())
+		plumtree_outbox.push_back(known_nodes[getId()]);
 	return known_nodes;
 }
 
-void Node::applyKnowledge(const std::unordered_map<NodeId, KnownInfoNode>& more)
+void Node::applyKnowledge(const std::vector<uint8_t>& payload)
 {
-	for (const auto& [node_id, info] : more) {
-		if (known_nodes.count(node_id) == 0 ||
-		    known_nodes.at(node_id).info_version < info.info_version)
-			known_nodes[node_id] = info;
+	auto is_needed = [this](NodeId node_id, size_t stamp) {
+		auto itr = known_nodes.find(node_id);
+		if (itr == known_nodes.end())
+			return !isForgotten(node_id, stamp);
+		return itr->second->stamp() < stamp;
+	};
+	auto apply = [this](KnownInfoRef&& info) {
+		setKnownInfo(std::move(info));
+	};
+	Propagation::copy_count += decodeKnowledge(payload, is_needed, apply);
+}
+
+bool Node::setKnownInfo(KnownInfoRef&& info)
+{
+	NodeId origin = info->origin;
+	if (info->dead && origin == getId() && leaving)
+		return false;
+	if (info->dead && origin == getId()) {
+		// Refute: the next own info will be newer than the tombstone.
+		updMax(self_info_version, info->info_version);
+		self_info_dirty = true;
+		noteChange();
+		return false;
+	}
+	if (info->dead && info->dead_time + TOMBSTONE_TTL <= Scheduler::now())
+		return false;
+	auto forgotten_itr = forgotten.find(origin);
+	if (forgotten_itr != forgotten.end()) {
+		if (info->stamp() <= forgotten_itr->second.first)
+			return false;
+		forgotten.erase(forgotten_itr);
 	}
+	uint64_t& bucket = digest_buckets[digestBucket(origin)];
+	bucket ^= digestHash(origin, info->stamp());
+	knowledge_hash ^= digestHash(origin, info->stamp());
+	KnownInfoRef& known = known_nodes[origin];
+	if (known) {
+		bucket ^= digestHash(origin, known->stamp());
+		knowledge_hash ^= digestHash(origin, known->stamp());
+		if (known->dead)
+			dead_count--;
+		else
+			Staleness::removeHolder(origin);
+		known->holder_count--;
+		updBridgeCandidates(*known, false);
+	}
+	info->holder_count++;
+	updBridgeCandidates(*info, true);
+	if (!info->dead)
+		Staleness::addHolder(origin);
+	if (!info->dead)
+		Convergence::update(*info);
+	// Propagation of updates, not initial sync of a new node.
+	if (known && !info->dead && origin != getId()) {
+		double delay = Scheduler::now() - info->time_created;
+		if (info->dc == dc)
+			Propagation::same_dc.update(delay);
+		else
+			Propagation::cross_dc.update(delay);
+	}
+	if (info->dead) {
+		dead_count++;
+		tombstones.emplace_back(origin, info->stamp());
+		known_direct_latency.erase(origin);
+	}
+	known = std::move(info);
+	noteChange();
+	return true;
+}
+
+void Node::markDead(NodeId node_id)
+{
+	removePassive(node_id);
+	auto itr = known_nodes.find(node_id);
+	if (itr == known_nodes.end() || itr->second->dead)
+		return;
+	size_t info_version = itr->second->info_version;
+	setTombstone(KnowledgeStore::internTombstone(node_id, info_version,
+						     Scheduler::now()));
+	Propagation::issued_count++;
+}
+
+bool Node::setTombstone(KnownInfoRef&& tombstone)
+{
+	NodeId node_id = tombstone->origin;
+	removePassive(node_id);
+	for (const auto& [conn_id, conn] : getConns())
+		getConn(conn_id).lazy_origins.erase(node_id);
+	last_rtt_time.erase(node_id);
+	echo_pending.erase(node_id);
+	if (!setKnownInfo(KnownInfoRef(tombstone)))
+		return false;
+	if (Options::usePlumtree())
+		plumtree_outbox.push_back(std::move(tombstone));
+	return true;
+}
+
+void Node::evictTombstones()
+{
+	while (!forgotten_order.empty()) {
+		auto [origin, time] = forgotten_order.front();
+		if (time + TOMBSTONE_TTL > Scheduler::now())
+			break;
+		forgotten_order.pop_front();
+		auto itr = forgotten.find(origin);
+		if (itr != forgotten.end() && itr->second.second == time)
+			forgotten.erase(itr);
+	}
+	while (!tombstones.empty()) {
+		auto [origin, stamp] = tombstones.front();
+		auto itr = known_nodes.find(origin);
+		if (itr == known_nodes.end() || itr->second->stamp() != stamp) {
+			tombstones.pop_front();
+			continue;
+		}
+		if (itr->second->dead_time + TOMBSTONE_TTL > Scheduler::now())
+			break;
+		tombstones.pop_front();
+		forgotten[origin] = {stamp, Scheduler::now()};
+		forgotten_order.emplace_back(origin, Scheduler::now());
+		eraseKnownInfo(itr);
+	}
+}
+
+bool Node::isForgotten(NodeId origin, size_t stamp) const
+{
+	auto itr = forgotten.find(origin);
+	return itr != forgotten.end() && stamp <= itr->second.first;
+}
+
+void Node::eraseKnownInfo(KnownInfoMap::iterator itr)
+{
+	const KnownInfoNode& info = *itr->second;
+	auto bucket = digest_buckets.find(digestBucket(info.origin));
+	bucket->second ^= digestHash(info.origin, info.stamp());
+	knowledge_hash ^= digestHash(info.origin, info.stamp());
+	if (info.dead)
+		dead_count--;
+	else
+		Staleness::removeHolder(info.origin);
+	info.holder_count--;
+	updBridgeCandidates(info, false);
+	known_nodes.erase(itr);
+}
+
+void Node::addPassive(NodeId node_id)
+{
+	if (node_id == getId() || hasPeer(node_id))
+		return;
+	auto itr = known_nodes.find(node_id);
+	if (itr != known_nodes.end() && itr->second->dead)
+		return;
+	for (NodeId id : passive_view)
+		if (id == node_id)
+			return;
+	if (passive_view.size() < PASSIVE_VIEW_SIZE)
+		passive_view.push_back(node_id);
+	else
+		passive_view[Rnd::choose(passive_view)] = node_id;
+}
+
+void Node::removePassive(NodeId node_id)
+{
+	auto pitr = std::find(passive_view.begin(), passive_view.end(), node_id);
+	if (pitr != passive_view.end()) {
+		*pitr = passive_view.back();
+		passive_view.pop_back();
+	}
+}
+
+void Node::prunePartialKnowledge()
+{
+	std::unordered_set<NodeId> keep;
+	keep.insert(getId());
+	for (NodeId id : passive_view)
+		keep.insert(id);
+	for (const auto& [peer_id, conns] : getPeersRaw()) {
+		keep.insert(peer_id);
+		auto itr = known_nodes.find(peer_id);
+		if (itr == known_nodes.end())
+			continue;
+		for (NodeId id : itr->second->peers)
+			keep.insert(id);
+	}
+	for (auto itr = known_nodes.begin(); itr != known_nodes.end(); ) {
+		auto cur = itr++;
+		if (keep.count(cur->first) == 0 && !cur->second->dead)
+			eraseKnownInfo(cur);
+	}
+}
+
+void Node::getNeighborhood(std::vector<const KnownInfoNode *>& res) const
+{
+	res.clear();
+	res.push_back(&*known_nodes.at(getId()));
+	for (const auto& [peer_id, conns] : getPeersRaw()) {
+		auto itr = known_nodes.find(peer_id);
+		if (itr != known_nodes.end() && !itr->second->dead)
+			res.push_back(&*itr->second);
+	}
+}
+
+void Node::getDigest(std::vector<std::pair<size_t, uint64_t>>& res) const
+{
+	res.assign(digest_buckets.begin(), digest_buckets.end());
+	std::sort(res.begin(), res.end());
 }
 
 struct ClusterStatus {
 	size_t max_hops;
 	double avg_hops;
 	size_t max_conns;
+	// Quantiles of connection counts of nodes.
+	size_t degree_p50;
+	size_t degree_p99;
 	double max_latency;
 	size_t far_node_count;
 	size_t inaccessible_node_count;
+	size_t known_info_count;
+	double avg_known_count;
+	// Traffic sent since the previous status and the length of the period.
+	TrafficCounters traffic;
+	size_t traffic_interval;
+	size_t node_count;
+	TrafficCounters cross_dc_traffic;
+	// Messages that arrived to removed nodes.
+	TrafficCounters wasted_traffic;
+	// Messages sent and received by a node since the previous status:
+	// average and the most of nodes.
+	double avg_node_msgs;
+	size_t max_node_msgs;
+	// Connections rejected and redirected since the previous status.
+	size_t reject_count;
+	size_t redirect_count;
+	// Connects suppressed and handshakes wasted since the previous status,
+	// current peers that a node has more than one connection to.
+	size_t suppressed_handshake_count;
+	size_t wasted_handshake_count;
+	size_t duplicate_peer_count;
+	// Quantiles of RTT samples since the previous status, averages of
+	// minimal and 99th percentile RTT of connections.
+	double link_latency_p50;
+	double link_latency_p99;
+	double avg_min_rtt;
+	double avg_tail_rtt;
+	// Average relative error of RTTs from sampled nodes to the others
+	// predicted by their coordinates, against twice the base latency.
+	double avg_coord_error;
+	// Propagation delays since the previous status.
+	SumMax propagation_same_dc;
+	SumMax propagation_cross_dc;
+	// Infos issued and received by gossip since the previous status.
+	size_t update_count;
+	size_t copy_count;
+	// Gossip rounds since the previous status and the current average
+	// interval between them.
+	size_t round_count;
+	double avg_gossip_interval;
+	// Average share of nodes that know the latest info of a node.
+	double latest_share;
+	// Delays to reach CONVERGENCE_LEVELS since the previous status.
+	SumMax convergence[CONVERGENCE_LEVEL_COUNT];
+	// Known infos that are behind the ground truth: outdated, of absent
+	// nodes or missing, per node and the most among STALENESS_SAMPLE
+	// nodes, and the average time since their latest versions were
+	// issued.
+	double avg_stale_count;
+	size_t max_stale_count;
+	double avg_stale_age;
+	// Simulation events since the previous status.
+	size_t event_count;
+	// Topology connect candidates since the previous status.
+	size_t candidate_evaluated_count;
+	size_t candidate_reused_count;
+	size_t candidate_move_count;
+	// Time the topology took to converge after the latest membership
+	// change, see TopologyConvergence.
+	size_t converge_time;
+	// Failure detection since the previous status.
+	SumMax detection_time;
+	size_t false_positive_count;
 };
 
+// Count of known infos of @a node that are behind the ground truth.
+inline size_t
+getStaleCount(const Node& node)
+{
+	size_t count = 0;
+	size_t alive_known = 0;
+	for (const auto& [origin, info] : node.known_nodes) {
+		if (info->dead)
+			continue;
+		const Node *origin_node = Cluster::findNode(origin);
+		if (origin_node == nullptr) {
+			// A ghost: its tombstone hasn't come yet.
+			count++;
+			continue;
+		}
+		alive_known++;
+		auto itr = origin_node->known_nodes.find(origin);
+		if (itr == origin_node->known_nodes.end())
+			continue;
+		const KnownInfoNode& latest = *itr->second;
+		if (info->stamp() < latest.stamp())
+			count++;
+	}
+	count += Cluster::getNodeCount() - alive_known;
+	return count;
+}
+
 ClusterStatus
 getClusterStatus()
 {
+	static TrafficCounters last_traffic;
+	static TrafficCounters last_cross_dc_traffic;
+	static TrafficCounters last_wasted_traffic;
+	static size_t last_issued = 0;
+	static size_t last_copies = 0;
+	static size_t last_rounds = 0;
+	static size_t last_events = 0;
+	static size_t last_false_positives = 0;
+	static size_t last_time = 0;
+	// Messages sent and received by nodes at the previous status.
+	static std::unordered_map<NodeId, size_t> last_node_msgs;
 	ClusterStatus res{};
 	const auto& nodes = Cluster::getNodes();
-	const auto& node_map = Cluster::getNodeMap();
-	std::vector<NodeId> tmp_peers;
-	std::vector<std::pair<NodeId, double>> tmp_jumps;
-	auto jump = [&tmp_peers, &tmp_jumps](NodeId id) -> std::vector<std::pair<NodeId, double>>& {
+	// Reused by all the statuses. Leaving nodes are not expected to be
+	// accessible and are not scanned from.
+	static std::vector<NodeId> ids;
+	static std::vector<NodeId> tmp_peers;
+	static Graph graph;
+	static Graph::Paths paths;
+	ids.clear();
+	for (const auto& node : nodes)
+		ids.push_back(node.getId());
+	auto get_row = [](NodeId id, auto& row) {
 		tmp_peers.clear();
-		tmp_jumps.clear();
 		Node *node = Cluster::findNode(id);
 		node->getEstablishedPeers(tmp_peers);
 		for (NodeId peer_id : tmp_peers) {
 			ConnId conn_id = node->getEstablishedPeerConn(peer_id);
 			auto& conn = node->getConn(conn_id);
-			double lat = conn.latency.get();
-			tmp_jumps.emplace_back(peer_id, lat);
+			row.emplace_back(peer_id, conn.latency.get());
 		}
-		return tmp_jumps;
+		return !node->leaving;
 	};
+	graph.build(ids, get_row);
+	size_t rtt_conn_count = 0;
+	// Known infos that are the latest ones of their origins.
+	size_t fresh_count = 0;
+	std::vector<size_t> degrees;
+	std::unordered_map<NodeId, size_t> node_msgs;
 	for (const auto& node: nodes) {
+		degrees.push_back(node.getConnCount());
+		size_t msgs = node.sent_traffic.totalCount() +
+			      node.recv_traffic.totalCount();
+		node_msgs[node.getId()] = msgs;
+		auto last = last_node_msgs.find(node.getId());
+		if (last != last_node_msgs.end())
+			msgs -= last->second;
+		res.avg_node_msgs += msgs;
+		updMax(res.max_node_msgs, msgs);
 		if (res.max_conns < node.getConnCount())
 			res.max_conns = node.getConnCount();
+		res.avg_known_count += node.known_nodes.size();
+		res.avg_gossip_interval += node.gossip_interval;
+		for (const auto& [peer_id, conns] : node.getPeersRaw())
+			if (conns.size() > 1)
+				res.duplicate_peer_count++;
+		auto itr = node.known_nodes.find(node.getId());
+		if (itr != node.known_nodes.end()) {
+			const KnownInfoNode& latest = *itr->second;
+			res.latest_share += latest.holder_count;
+			// Nodes that hold an older version of it.
+			size_t outdated =
+				Staleness::holder_count.at(node.getId()) -
+				latest.holder_count;
+			fresh_count += latest.holder_count;
+			res.avg_stale_age += outdated *
+				double(Scheduler::now() - latest.time_created);
+		}
+		for (const auto& [conn_id, conn] : node.getConns()) {
+			if (!conn.min_rtt.is())
+				continue;
+			res.avg_min_rtt += conn.min_rtt.get();
+			res.avg_tail_rtt += conn.tail_rtt.get();
+			rtt_conn_count++;
+		}
+	}
+	if (rtt_conn_count != 0) {
+		res.avg_min_rtt /= rtt_conn_count;
+		res.avg_tail_rtt /= rtt_conn_count;
+	}
+	res.link_latency_p50 = LinkLatency::samples.getQuantile(.5);
+	res.link_latency_p99 = LinkLatency::samples.getQuantile(.99);
+	LinkLatency::samples.clear();
+	last_node_msgs = std::move(node_msgs);
+	res.avg_node_msgs /= nodes.size();
+	if (!degrees.empty()) {
+		std::sort(degrees.begin(), degrees.end());
+		res.degree_p50 = degrees[degrees.size() / 2];
+		res.degree_p99 = degrees[degrees.size() * 99 / 100];
+	}
+	res.avg_known_count /= nodes.size();
+	res.avg_gossip_interval /= nodes.size();
+	res.latest_share /= double(nodes.size()) * nodes.size();
+	// Every node is expected to know the latest infos of all the nodes
+	// and nothing of absent ones.
+	size_t ghost_count = 0;
+	for (const auto& [origin, count] : Staleness::holder_count)
+		if (Cluster::findNode(origin) == nullptr)
+			ghost_count += count;
+	size_t stale_total = nodes.size() * nodes.size() + ghost_count -
+			     fresh_count;
+	res.avg_stale_count = double(stale_total) / nodes.size();
+	if (stale_total != 0)
+		res.avg_stale_age /= stale_total;
+	for (size_t i = 0; i < nodes.size();
+	     i += std::max<size_t>(nodes.size() / STALENESS_SAMPLE, 1))
+		updMax(res.max_stale_count, getStaleCount(nodes[i]));
 
-		auto scan = scanGraph(node.getId(), node_map, jump);
+	// Scan from every node or from evenly spread sample of them.
+	size_t step = 1;
+	if (Options::status_sample != 0 &&
+	    Options::status_sample < nodes.size())
+		step = nodes.size() / Options::status_sample;
+	size_t scan_count = 0;
+	size_t coord_pair_count = 0;
+	for (size_t i = 0; i < nodes.size(); i += step) {
+		if (nodes[i].leaving)
+			continue;
+		auto scan = graph.scan(nodes[i].getId(), Options::path_metric,
+				       paths);
 		updMax(res.max_hops, scan.max_hops);
 		updMax(res.max_latency, scan.max_latency);
 		res.avg_hops += scan.avg_hops;
 		res.far_node_count += scan.far_node_count;
-		res.inaccessible_node_count += scan.inaccessible_nodes.size();
+		res.inaccessible_node_count += scan.inaccessible_count;
+		for (const auto& node : nodes) {
+			if (&node == &nodes[i])
+				continue;
+			double rtt = 2. * nodes[i].getBaseLatency(&node);
+			double predicted = nodes[i].coord.distance(node.coord);
+			res.avg_coord_error += std::fabs(predicted - rtt) / rtt;
+			coord_pair_count++;
+		}
+		scan_count++;
+	}
+	if (coord_pair_count != 0)
+		res.avg_coord_error /= coord_pair_count;
+	if (scan_count != 0) {
+		res.avg_hops /= scan_count;
+		res.far_node_count =
+			res.far_node_count * nodes.size() / scan_count;
+		res.inaccessible_node_count =
+			res.inaccessible_node_count * nodes.size() / scan_count;
+	}
+	res.converge_time = TopologyConvergence::update(res.far_node_count);
+	res.known_info_count = KnowledgeStore::getInfoCount();
+	res.traffic = Traffic::getSent() - last_traffic;
+	res.traffic_interval = Scheduler::now() - last_time;
+	res.node_count = nodes.size();
+	last_traffic = Traffic::getSent();
+	res.cross_dc_traffic = Traffic::getCrossDc() - last_cross_dc_traffic;
+	last_cross_dc_traffic = Traffic::getCrossDc();
+	res.wasted_traffic = Traffic::getWasted() - last_wasted_traffic;
+	last_wasted_traffic = Traffic::getWasted();
+	res.propagation_same_dc = Propagation::same_dc;
+	res.propagation_cross_dc = Propagation::cross_dc;
+	Propagation::same_dc = SumMax{};
+	Propagation::cross_dc = SumMax{};
+	for (size_t i = 0; i < CONVERGENCE_LEVEL_COUNT; i++) {
+		res.convergence[i] = Convergence::time[i];
+		Convergence::time[i] = SumMax{};
 	}
-	res.avg_hops /= nodes.size();
+	res.update_count = Propagation::issued_count - last_issued;
+	last_issued = Propagation::issued_count;
+	res.copy_count = Propagation::copy_count - last_copies;
+	last_copies = Propagation::copy_count;
+	res.candidate_evaluated_count = TopologyCandidates::evaluated_count;
+	TopologyCandidates::evaluated_count = 0;
+	res.candidate_reused_count = TopologyCandidates::reused_count;
+	TopologyCandidates::reused_count = 0;
+	res.candidate_move_count = TopologyCandidates::move_count;
+	TopologyCandidates::move_count = 0;
+	res.reject_count = Admission::reject_count;
+	res.redirect_count = Admission::redirect_count;
+	Admission::reject_count = 0;
+	Admission::redirect_count = 0;
+	res.suppressed_handshake_count = Handshakes::suppressed_count;
+	res.wasted_handshake_count = Handshakes::wasted_count;
+	Handshakes::suppressed_count = 0;
+	Handshakes::wasted_count = 0;
+	res.detection_time = FailureDetection::detection_time;
+	FailureDetection::detection_time = SumMax{};
+	res.false_positive_count =
+		FailureDetection::false_positive_count - last_false_positives;
+	last_false_positives = FailureDetection::false_positive_count;
+	res.event_count = Scheduler::getEventCount() - last_events;
+	last_events = Scheduler::getEventCount();
+	res.round_count = Propagation::round_count - last_rounds;
+	last_rounds = Propagation::round_count;
+	last_time = Scheduler::now();
 	return res;
 }
 
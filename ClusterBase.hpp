@@ -117,6 +117,7 @@ public:
 	template <class... ARGS>
 	static NodeId addNode(ARGS&&... args);
 	static NodeId delNode();
+	static void delNode(NodeId id);
 	static NODE *findNode(NodeId id);
 	static const std::vector<NODE>& getNodes() { return instance().nodes; }
 	static const std::unordered_map<NodeId, size_t>& getNodeMap() { return instance().id_to_idx; }
@@ -175,7 +176,9 @@ NodeBase<CONN>::~NodeBase() noexcept
 
 template <class CONN>
 NodeBase<CONN>::NodeBase(NodeBase&& n) noexcept
-	: PhysicalNode(std::move(n)), id(n.id), idx(n.idx)
+	: PhysicalNode(std::move(n)), id(n.id), idx(n.idx),
+	  conn_by_id(std::move(n.conn_by_id)),
+	  conn_by_peer(std::move(n.conn_by_peer))
 {
 	n.dispose();
 }
@@ -184,8 +187,11 @@ template <class CONN>
 NodeBase<CONN>&
 NodeBase<CONN>::operator=(NodeBase&& n) noexcept
 {
+	PhysicalNode::operator=(n);
 	std::swap(id, n.id);
 	std::swap(idx, n.idx);
+	std::swap(conn_by_id, n.conn_by_id);
+	std::swap(conn_by_peer, n.conn_by_peer);
 	return *this;
 }
 
@@ -424,16 +430,26 @@ ClusterBase<NODE>::delNode()
 {
 	ClusterBase<NODE>& inst = instance();
 	assert(inst.nodes.size() > 0);
-	size_t idx = Rnd::choose(inst.nodes);
-	NodeId id = inst.nodes[idx].id;
+	NodeId id = inst.nodes[Rnd::choose(inst.nodes)].id;
+	delNode(id);
+	return id;
+}
+
+template <class NODE>
+void
+ClusterBase<NODE>::delNode(NodeId id)
+{
+	ClusterBase<NODE>& inst = instance();
+	size_t idx = inst.id_to_idx.at(id);
 	assert(inst.nodes[idx].idx == idx);
 	inst.id_to_idx.erase(inst.nodes[idx].id);
-	inst.nodes[idx] = std::move(inst.nodes.back());
-	inst.nodes[idx].idx = idx;
-	inst.id_to_idx[inst.nodes[idx].id] = idx;
+	if (idx + 1 != inst.nodes.size()) {
+		inst.nodes[idx] = std::move(inst.nodes.back());
+		inst.nodes[idx].idx = idx;
+		inst.id_to_idx[inst.nodes[idx].id] = idx;
+	}
 	inst.nodes.back().dispose();
 	inst.nodes.pop_back();
-	return id;
 }
 
 template <class NODE>
@@ -35,12 +35,90 @@ constexpr size_t MINIMAL_LATENCY = 500;
 // 2.0 - randomly plus around 100%.
 constexpr double LATENCY_RANDOM_COEF = 1.1;
 
+// Throughput of a link between two nodes, bytes per microsecond (1 Gbit/s).
+constexpr size_t LINK_BANDWIDTH = 125;
+
+// Wire format
+constexpr size_t WIRE_LATENCY_QUANTUM = 8;
+// Default change of latency to a peer that makes a node reissue its info,
+// percent of the published latency.
+constexpr size_t LATENCY_CHANGE_THRESHOLD = 25;
+
+// Anti-entropy gossip: number of consecutive node ids in a digest bucket.
+constexpr size_t DIGEST_BUCKET_SIZE = 32;
+
+// Topology: sequences of moves a think extends at every length, the
+// default number of candidate evaluations it spends on them and the
+// evaluations a rebuild of paths after a sequence is charged as, about
+// its time at 200 nodes.
+constexpr size_t TOPOLOGY_BEAM_WIDTH = 4;
+constexpr size_t TOPOLOGY_MOVE_BUDGET = 256;
+constexpr size_t TOPOLOGY_REBUILD_COST = 50;
+// Share of the least far_node_count since the latest membership change
+// that the topology is converged within.
+constexpr double TOPOLOGY_CONVERGED_SHARE = .05;
+
 // Cluster settings
 constexpr size_t INITIAL_CONNECT_COUNT = 3;
 constexpr double CONN_COEF = 1.5;
 constexpr size_t THINK_INTERVAL = 10000;
 constexpr size_t HEARTBEAT_INTERVAL = 1000;
 constexpr size_t GOSSIP_INTERVAL = 5000;
-//constexpr size_t FAREWELL_INTERVAL = 1000000;
+// Time a node doesn't try to connect to a node that has rejected it.
+constexpr size_t ADMISSION_BACKOFF = 10 * THINK_INTERVAL;
+// Adaptive heartbeat: a connection probes twice as rare after that many
+// steady RTT samples, but not rarer than the detection budget share.
+constexpr size_t HEARTBEAT_STABLE_SAMPLES = 8;
+constexpr size_t HEARTBEAT_BUDGET_SHARE = 4;
+// Default failure detection budget and RTT deviation (percent of RTT)
+// that is still steady.
+constexpr size_t DETECTION_BUDGET = 40000;
+constexpr size_t HEARTBEAT_JITTER = 15;
+// Weight of a sample in smoothed RTT deviation.
+constexpr double RTT_DEVIATION_ALPHA = 0.25;
+// Phi-accrual failure detector: suspicion level to drop a peer and the
+// least deviation of heartbeat intervals it assumes.
+constexpr double PHI_THRESHOLD = 8;
+constexpr double PHI_MIN_STDDEV = HEARTBEAT_INTERVAL / 2;
+// Adaptive gossip cadence: the interval doubles up to that while the
+// knowledge of a node doesn't change.
+constexpr size_t GOSSIP_INTERVAL_MAX = 16 * GOSSIP_INTERVAL;
+// Time a leaving node waits for messages in flight before removal.
+constexpr size_t FAREWELL_INTERVAL = 4 * CROSS_DC_LATENCY;
 constexpr double INTERVAL_RANDOM_COEF = 1.1;
+// Plumtree: time to wait for an announced info before grafting it.
+constexpr size_t GRAFT_TIMEOUT = 2 * GOSSIP_INTERVAL;
+// Plumtree: anti-entropy digest exchange every that many gossip rounds.
+constexpr size_t PLUMTREE_ANTI_ENTROPY_ROUNDS = 4;
+// Shares of nodes an info version reaches, see Convergence.
+constexpr size_t CONVERGENCE_LEVEL_COUNT = 4;
+constexpr double CONVERGENCE_LEVELS[CONVERGENCE_LEVEL_COUNT] = {.5, .9, .99, 1.};
+// Nodes that cluster status scans for the most stale of them.
+constexpr size_t STALENESS_SAMPLE = 16;
+// DC-aware gossip
+constexpr size_t CROSS_DC_GOSSIP_INTERVAL = 20000;
+constexpr size_t DC_BRIDGE_COUNT = 2;
+
+// Partial view membership
+constexpr size_t ACTIVE_VIEW_SIZE = 6;
+constexpr size_t PASSIVE_VIEW_SIZE = 30;
+// Times a join is forwarded by full active views before one makes room.
+constexpr size_t FORWARD_WALK_LENGTH = 6;
+constexpr size_t SHUFFLE_SIZE = 8;
+constexpr size_t SHUFFLE_INTERVAL = 20000;
+// Time window of minimal RTT of a connection.
+constexpr size_t MIN_RTT_WINDOW = 10 * GOSSIP_INTERVAL;
+// Time a death certificate is kept and gossiped before the node is forgotten.
+constexpr size_t TOMBSTONE_TTL = 200000;
+
+// Vivaldi network coordinates: weights of an RTT sample in the error and
+// in the move of a coordinate, the error of a new coordinate and the error
+// under which it predicts latencies, the least height and the move (plane
+// plus height) that makes a node reissue its info.
+constexpr double COORD_ERROR_WEIGHT = .25;
+constexpr double COORD_MOVE_WEIGHT = .25;
+constexpr double COORD_MAX_ERROR = 1.5;
+constexpr double COORD_TRUSTED_ERROR = .5;
+constexpr double COORD_MIN_HEIGHT = 10;
+constexpr double COORD_CHANGE_THRESHOLD = MINIMAL_LATENCY;
 
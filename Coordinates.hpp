@@ -0,0 +1,103 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <Constants.hpp>
+#include <Utils.hpp>
+#include <Wire.hpp>
+
+// Vivaldi network coordinate: a point in a plane and a height above it,
+// that models the access link. Predicted RTT between two nodes is the
+// distance in the plane plus both heights. Every RTT sample to a peer
+// pushes the coordinate away from or pulls it to the peer's one, the more
+// the more accurate the peer is relative to the node.
+struct NetCoord {
+	float x = 0;
+	float y = 0;
+	float height = COORD_MIN_HEIGHT;
+	// Relative error of predicted RTTs.
+	float error = COORD_MAX_ERROR;
+
+	double distance(const NetCoord& c) const
+	{
+		return std::hypot(x - c.x, y - c.y) + height + c.height;
+	}
+	// Distance in the plane plus the change of height.
+	double moved(const NetCoord& c) const
+	{
+		return std::hypot(x - c.x, y - c.y) +
+		       std::fabs(height - c.height);
+	}
+	// Whether the coordinate predicts well enough to be used.
+	bool isTrusted() const { return error < COORD_TRUSTED_ERROR; }
+	// Apply a sample of @a rtt to a node of coordinate @a remote.
+	void update(const NetCoord& remote, double rtt);
+};
+
+void
+NetCoord::update(const NetCoord& remote, double rtt)
+{
+	if (rtt <= 0)
+		return;
+	double dist = distance(remote);
+	double weight = error / (error + remote.error);
+	double sample_error = std::fabs(dist - rtt) / rtt;
+	double k = COORD_ERROR_WEIGHT * weight;
+	error = std::min(sample_error * k + error * (1 - k), COORD_MAX_ERROR);
+
+	double dx = x - remote.x;
+	double dy = y - remote.y;
+	double plane = std::hypot(dx, dy);
+	if (plane == 0) {
+		// Coincident nodes go apart in a random direction.
+		double angle = Rnd::getDbl(2 * PI);
+		dx = std::cos(angle);
+		dy = std::sin(angle);
+		plane = 1;
+	}
+	// Along the unit vector from the remote, the heights add up.
+	double len = plane + height + remote.height;
+	double force = COORD_MOVE_WEIGHT * weight * (rtt - dist);
+	x += force * dx / len;
+	y += force * dy / len;
+	height += force * (height + remote.height) / len;
+	height = std::max(height, float(COORD_MIN_HEIGHT));
+}
+
+// Wire format of a coordinate: zigzag varint x and y and varint height,
+// quantized as latencies, and varint error in thousandths.
+inline size_t
+coordWireSize(const NetCoord& c)
+{
+	return varintSize(zigzag(quantizeOffset(c.x))) +
+	       varintSize(zigzag(quantizeOffset(c.y))) +
+	       varintSize(quantizeLatency(c.height)) +
+	       varintSize(uint64_t(c.error * 1000 + .5));
+}
+
+inline void
+putCoord(WireWriter& w, const NetCoord& c)
+{
+	w.putVarint(zigzag(quantizeOffset(c.x)));
+	w.putVarint(zigzag(quantizeOffset(c.y)));
+	w.putVarint(quantizeLatency(c.height));
+	w.putVarint(uint64_t(c.error * 1000 + .5));
+}
+
+inline NetCoord
+getCoord(WireReader& r)
+{
+	NetCoord c;
+	c.x = dequantizeOffset(unzigzag(r.getVarint()));
+	c.y = dequantizeOffset(unzigzag(r.getVarint()));
+	c.height = dequantizeLatency(r.getVarint());
+	c.error = r.getVarint() / 1000.;
+	return c;
+}
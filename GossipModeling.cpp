@@ -10,11 +10,15 @@
 #include <JobConnect.hpp>
 #include <JobHeartbeat.hpp>
 #include <JobGossip.hpp>
+#include <JobLeave.hpp>
+#include <JobShuffle.hpp>
 #include <JobTopology.hpp>
+#include <Options.hpp>
 #include <Scheduler.hpp>
 
 void addNode(size_t num)
 {
+	TopologyConvergence::noteChange();
 	std::vector<NodeId> initial_conns;
 	initial_conns.reserve(INITIAL_CONNECT_COUNT);
 	auto& nodes = Cluster::getNodes();
@@ -44,6 +48,7 @@ void addNode(size_t num)
 		jobSchedule(JobHeartbeat{node_id});
 		jobSchedule(JobGossip{node_id});
 		jobSchedule(JobTopology{node_id});
+		jobSchedule(JobShuffle{node_id});
 		if (initial_conns.size() < INITIAL_CONNECT_COUNT) {
 			initial_conns.push_back(node_id);
 		}
@@ -52,8 +57,114 @@ void addNode(size_t num)
 
 void delNode(size_t num)
 {
+	TopologyConvergence::noteChange();
 	for (size_t i = 0; i < num; i++)
-		Cluster::delNode();
+		FailureDetection::noteDeath(Cluster::delNode());
+}
+
+void leaveNode(size_t num)
+{
+	TopologyConvergence::noteChange();
+	std::vector<NodeId> staying;
+	for (const Node& node : Cluster::getNodes())
+		if (!node.leaving)
+			staying.push_back(node.getId());
+	for (size_t i = 0; i < num && !staying.empty(); i++) {
+		size_t j = Rnd::choose(staying);
+		jobSchedule(JobLeave{staying[j]});
+		staying[j] = staying.back();
+		staying.pop_back();
+	}
+}
+
+// Bytes per second sent by an average node, by message type.
+struct BandwidthReport {
+	const ClusterStatus &status;
+	const TrafficCounters &traffic;
+
+	explicit BandwidthReport(const ClusterStatus &status_)
+		: status(status_), traffic(status_.traffic) {}
+	BandwidthReport(const ClusterStatus &status_,
+			const TrafficCounters &traffic_)
+		: status(status_), traffic(traffic_) {}
+};
+
+std::ostream& operator<<(std::ostream &strm, const BandwidthReport &report)
+{
+	const ClusterStatus &status = report.status;
+	double k = 0;
+	if (status.traffic_interval != 0 && status.node_count != 0)
+		k = 1e6 / status.traffic_interval / status.node_count;
+	const TrafficCounters &traffic = report.traffic;
+	strm << "{total: " << size_t(traffic.totalBytes() * k);
+	for (size_t i = 0; i < MSG_TYPE_COUNT; i++) {
+		if (traffic.count[i] == 0)
+			continue;
+		strm << ", " << MSG_NAMES[i] << ": "
+		     << size_t(traffic.bytes[i] * k);
+	}
+	strm << "}";
+	return strm;
+}
+
+// Events per second per node.
+struct RateReport {
+	const ClusterStatus &status;
+	size_t count;
+};
+
+std::ostream& operator<<(std::ostream &strm, const RateReport &report)
+{
+	const ClusterStatus &status = report.status;
+	double k = 0;
+	if (status.traffic_interval != 0 && status.node_count != 0)
+		k = 1e6 / status.traffic_interval / status.node_count;
+	return strm << report.count * k;
+}
+
+// Knowledge spreading messages and received copies per issued info.
+struct GossipPerUpdate {
+	const ClusterStatus &status;
+};
+
+std::ostream& operator<<(std::ostream &strm, const GossipPerUpdate &report)
+{
+	const ClusterStatus &status = report.status;
+	size_t count = 0;
+	for (size_t i = 0; i < MSG_TYPE_COUNT; i++)
+		if (isGossipMsg(Msg_t(i)))
+			count += status.traffic.count[i];
+	double k = 0;
+	if (status.update_count != 0)
+		k = 1. / status.update_count;
+	strm << "{msgs: " << count * k << ", copies: "
+	     << status.copy_count * k << "}";
+	return strm;
+}
+
+std::ostream& operator<<(std::ostream &strm, const SumMax &delay)
+{
+	strm << "{avg: " << delay.getAvg() << ", max: " << delay.getMax()
+	     << "}";
+	return strm;
+}
+
+// Delays of reaching shares of nodes by info versions.
+struct ConvergenceReport {
+	const ClusterStatus &status;
+};
+
+std::ostream& operator<<(std::ostream &strm, const ConvergenceReport &report)
+{
+	strm << "{";
+	for (size_t i = 0; i < CONVERGENCE_LEVEL_COUNT; i++) {
+		if (i != 0)
+			strm << ", ";
+		strm << CONVERGENCE_LEVELS[i] * 100 << "%: "
+		     << report.status.convergence[i];
+	}
+	strm << "}";
+	return strm;
 }
 
 std::ostream& operator<<(std::ostream &strm, const ClusterStatus &status)
@@ -61,9 +172,50 @@ std::ostream& operator<<(std::ostream &strm, const ClusterStatus &status)
 	strm << "{max_hops = " << status.max_hops
 	     << ", avg_hops = " << status.avg_hops
 	     << ", max_conns = " << status.max_conns
+	     << ", degree = {p50: " << status.degree_p50
+	     << ", p99: " << status.degree_p99 << "}"
 	     << ", max_latency = " << status.max_latency
 	     << ", far_node_count = " << status.far_node_count
 	     << ", unknown_node_count = " << status.inaccessible_node_count
+	     << ", known_info_count = " << status.known_info_count
+	     << ", avg_known_count = " << status.avg_known_count
+	     << ", bandwidth = " << BandwidthReport{status}
+	     << ", cross_dc_bandwidth = "
+	     << BandwidthReport{status, status.cross_dc_traffic}
+	     << ", propagation_same_dc = " << status.propagation_same_dc
+	     << ", propagation_cross_dc = " << status.propagation_cross_dc
+	     << ", per_update = " << GossipPerUpdate{status}
+	     << ", link_latency = {p50: " << status.link_latency_p50
+	     << ", p99: " << status.link_latency_p99
+	     << ", min: " << status.avg_min_rtt
+	     << ", tail: " << status.avg_tail_rtt << "}"
+	     << ", coord_error = " << status.avg_coord_error
+	     << ", node_msgs = {avg: " << status.avg_node_msgs
+	     << ", max: " << status.max_node_msgs << "}"
+	     << ", admission = {rejects: " << status.reject_count
+	     << ", redirects: " << status.redirect_count << "}"
+	     << ", handshakes = {suppressed: "
+	     << status.suppressed_handshake_count
+	     << ", wasted: " << status.wasted_handshake_count
+	     << ", duplicates: " << status.duplicate_peer_count << "}"
+	     << ", wasted = {msgs: " << status.wasted_traffic.totalCount()
+	     << ", bytes: " << status.wasted_traffic.totalBytes() << "}"
+	     << ", candidates = {evaluated: "
+	     << status.candidate_evaluated_count
+	     << ", reused: " << status.candidate_reused_count
+	     << ", moves: " << status.candidate_move_count << "}"
+	     << ", converge_time = " << status.converge_time
+	     << ", failure_detection = {time: " << status.detection_time
+	     << ", count: " << status.detection_time.getCount()
+	     << ", false_positives: " << status.false_positive_count << "}"
+	     << ", events = " << RateReport{status, status.event_count}
+	     << ", gossip_rounds = " << RateReport{status, status.round_count}
+	     << ", avg_gossip_interval = " << status.avg_gossip_interval
+	     << ", latest_share = " << status.latest_share
+	     << ", convergence = " << ConvergenceReport{status}
+	     << ", stale = {avg: " << status.avg_stale_count
+	     << ", max: " << status.max_stale_count
+	     << ", age: " << status.avg_stale_age << "}"
 	     << "}";
 	return strm;
 }
@@ -85,6 +237,11 @@ int main()
 			std::cin >> num;
 			std::cout << "deleting " << num << std::endl;
 			delNode(num);
+		} else if (str == "leave") {
+			size_t num;
+			std::cin >> num;
+			std::cout << "leaving " << num << std::endl;
+			leaveNode(num);
 		} else if (str == "wait") {
 			size_t num;
 			std::cin >> num;
@@ -123,6 +280,13 @@ int main()
 //				}
 //				std::cout << std::endl;
 //			}
+		} else if (str == "set") {
+			std::string name, value;
+			std::cin >> name >> value;
+			if (Options::set(name, value))
+				std::cout << "set " << name << " = " << value << std::endl;
+			else
+				std::cout << "unknown option " << name << " " << value << std::endl;
 		} else if (str == "print") {
 			std::cout << "graph G {\n";
 			const char *colors[3] = {"red", "green", "blue"};
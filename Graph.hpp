@@ -0,0 +1,384 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <KnowledgeStore.hpp>
+#include <Options.hpp>
+#include <Types.hpp>
+#include <Utils.hpp>
+
+// Min-heap of monotone integer keys: a key is in the bucket of the highest
+// bit it differs from the last popped one in.
+class RadixHeap {
+public:
+	bool empty() const { return count == 0; }
+	void clear()
+	{
+		for (auto& bucket : buckets)
+			bucket.clear();
+		last = 0;
+		count = 0;
+	}
+	void push(uint64_t key, uint32_t v)
+	{
+		buckets[bucketOf(key)].emplace_back(key, v);
+		count++;
+	}
+	std::pair<uint64_t, uint32_t> pop();
+
+private:
+	size_t bucketOf(uint64_t key) const
+	{
+		uint64_t diff = key ^ last;
+		return diff == 0 ? 0 : 64 - __builtin_clzll(diff);
+	}
+
+	std::array<std::vector<std::pair<uint64_t, uint32_t>>, 65> buckets;
+	uint64_t last = 0;
+	size_t count = 0;
+};
+
+// A frozen graph: vertices and latencies of their edges in compressed rows,
+// latencies are integer microseconds. Finds paths from a vertex with the
+// least hops (and the least latency among them) or the least latency.
+class Graph {
+public:
+	static constexpr uint32_t NO_VERTEX = std::numeric_limits<uint32_t>::max();
+	static constexpr uint32_t NO_HOPS = std::numeric_limits<uint32_t>::max();
+
+	struct Edge {
+		uint32_t to;
+		uint32_t latency;
+	};
+
+	// Metrics of paths from a vertex, inaccessible are alive vertices.
+	struct Scan {
+		size_t max_hops = 0;
+		double avg_hops = 0;
+		double max_latency = 0;
+		double avg_latency = 0;
+		size_t far_node_count = 0;
+		size_t reached_count = 0;
+		size_t inaccessible_count = 0;
+	};
+
+	// Hops and latency of the paths to every vertex and the workspace to
+	// find them, reused by searches over any graphs. Vertices with
+	// stamp != epoch are not reached, so a search starts in O(1).
+	class Paths {
+	public:
+		uint32_t getHops(uint32_t v) const
+		{
+			return stamp[v] == epoch ? hops[v] : NO_HOPS;
+		}
+		uint64_t getLatency(uint32_t v) const { return latency[v]; }
+
+	private:
+		friend class Graph;
+		uint32_t epoch = 0;
+		std::vector<uint32_t> stamp;
+		std::vector<uint32_t> hops;
+		std::vector<uint64_t> latency;
+		std::vector<uint32_t> wave;
+		std::vector<uint32_t> next_wave;
+		RadixHeap heap;
+	};
+
+	// Vertices are @a ids and their peers, get_row(id, row) fills pairs
+	// of peer id and latency of edges of id and returns whether id is
+	// alive.
+	template <class GET_ROW>
+	void build(const std::vector<NodeId>& ids, GET_ROW&& get_row);
+	// Knowledge of a node, @a origin is vertex 0, known nodes that are
+	// not dead are alive.
+	void build(NodeId origin, const KnownInfoMap& known);
+	// Same with edges of the origin given by @a origin_row, pairs of peer
+	// id and latency.
+	void build(NodeId origin, const KnownInfoMap& known,
+		   const std::vector<std::pair<NodeId, double>>& origin_row);
+
+	// Integer latency of an edge of @a latency, at least 1.
+	static uint32_t toLatency(double latency)
+	{
+		return std::max(uint32_t(latency + .5), uint32_t(1));
+	}
+
+	size_t size() const { return vertex_ids.size(); }
+	uint32_t find(NodeId id) const;
+	NodeId getId(uint32_t v) const { return vertex_ids[v]; }
+	bool isAlive(uint32_t v) const { return is_alive[v]; }
+	const Edge *begin(uint32_t v) const
+	{
+		return edges.data() + row_begin[v];
+	}
+	const Edge *end(uint32_t v) const
+	{
+		return edges.data() + row_begin[v + 1];
+	}
+
+	// Find @a paths from @a origin by @a metric and their metrics.
+	Scan findPaths(uint32_t origin, PathMetric_t metric,
+		       Paths& paths) const;
+	Scan scan(NodeId origin, PathMetric_t metric, Paths& paths) const;
+
+private:
+	void buildKnown(NodeId origin, const KnownInfoMap& known,
+			const std::vector<std::pair<NodeId, double>> *origin_row);
+	uint32_t index(NodeId id);
+	void addRow();
+	void finishRows();
+	bool reach(Paths& paths, uint32_t v) const;
+	void addReached(Scan& res, Paths& paths, uint32_t v) const;
+	void findLeastHops(uint32_t origin, Paths& paths, Scan& res) const;
+	void findLeastLatency(uint32_t origin, Paths& paths, Scan& res) const;
+
+	std::unordered_map<NodeId, uint32_t> ids;
+	std::vector<NodeId> vertex_ids;
+	std::vector<char> is_alive;
+	size_t alive_count;
+	std::vector<uint32_t> row_begin;
+	std::vector<Edge> edges;
+	std::vector<std::pair<NodeId, double>> row;
+};
+
+template <class GET_ROW>
+void
+Graph::build(const std::vector<NodeId>& vids, GET_ROW&& get_row)
+{
+	ids.clear();
+	vertex_ids.clear();
+	is_alive.clear();
+	row_begin.clear();
+	edges.clear();
+	alive_count = 0;
+	for (NodeId id : vids)
+		index(id);
+	for (NodeId id : vids) {
+		row.clear();
+		bool alive = get_row(id, row);
+		is_alive[row_begin.size()] = alive;
+		alive_count += alive;
+		addRow();
+	}
+	finishRows();
+}
+
+void
+Graph::build(NodeId origin, const KnownInfoMap& known)
+{
+	buildKnown(origin, known, nullptr);
+}
+
+void
+Graph::build(NodeId origin, const KnownInfoMap& known,
+	     const std::vector<std::pair<NodeId, double>>& origin_row)
+{
+	buildKnown(origin, known, &origin_row);
+}
+
+void
+Graph::buildKnown(NodeId origin, const KnownInfoMap& known,
+		  const std::vector<std::pair<NodeId, double>> *origin_row)
+{
+	std::vector<NodeId> vids{origin};
+	for (const auto& [id, info] : known)
+		if (id != origin)
+			vids.push_back(id);
+	build(vids, [&](NodeId id, auto& row) {
+		if (id == origin && origin_row != nullptr) {
+			row.insert(row.end(), origin_row->begin(),
+				   origin_row->end());
+			return true;
+		}
+		auto itr = known.find(id);
+		if (itr == known.end())
+			return false;
+		const KnownInfoNode& info = *itr->second;
+		for (size_t i = 0; i < info.size(); i++)
+			row.emplace_back(info.peers[i], info.latencies[i]);
+		return !info.dead;
+	});
+}
+
+uint32_t
+Graph::find(NodeId id) const
+{
+	auto itr = ids.find(id);
+	return itr == ids.end() ? NO_VERTEX : itr->second;
+}
+
+uint32_t
+Graph::index(NodeId id)
+{
+	auto [itr, inserted] = ids.try_emplace(id, uint32_t(ids.size()));
+	if (inserted) {
+		vertex_ids.push_back(id);
+		is_alive.push_back(0);
+	}
+	return itr->second;
+}
+
+void
+Graph::addRow()
+{
+	row_begin.push_back(edges.size());
+	for (const auto& [peer_id, latency] : row)
+		edges.push_back(Edge{index(peer_id), toLatency(latency)});
+}
+
+void
+Graph::finishRows()
+{
+	// Peers that are not given have no edges.
+	row_begin.resize(size() + 1, edges.size());
+}
+
+bool
+Graph::reach(Paths& paths, uint32_t v) const
+{
+	if (paths.stamp[v] == paths.epoch)
+		return false;
+	paths.stamp[v] = paths.epoch;
+	return true;
+}
+
+void
+Graph::addReached(Scan& res, Paths& paths, uint32_t v) const
+{
+	size_t hops = paths.hops[v];
+	double lat = paths.latency[v];
+	updMax(res.max_hops, hops);
+	updMax(res.max_latency, lat);
+	res.avg_hops += hops;
+	res.avg_latency += lat;
+	if (hops > 2)
+		res.far_node_count++;
+	res.reached_count++;
+	res.inaccessible_count -= is_alive[v];
+}
+
+Graph::Scan
+Graph::findPaths(uint32_t origin, PathMetric_t metric, Paths& paths) const
+{
+	if (paths.stamp.size() < size()) {
+		paths.stamp.resize(size(), 0);
+		paths.hops.resize(size());
+		paths.latency.resize(size());
+	}
+	if (++paths.epoch == 0) {
+		std::fill(paths.stamp.begin(), paths.stamp.end(), 0);
+		paths.epoch = 1;
+	}
+	reach(paths, origin);
+	paths.hops[origin] = 0;
+	paths.latency[origin] = 0;
+
+	Scan res;
+	res.inaccessible_count = alive_count - is_alive[origin];
+	if (metric == PATH_METRIC_HOPS)
+		findLeastHops(origin, paths, res);
+	else
+		findLeastLatency(origin, paths, res);
+	// The origin is counted in averages.
+	res.avg_hops /= res.reached_count + 1;
+	res.avg_latency /= res.reached_count + 1;
+	return res;
+}
+
+void
+Graph::findLeastHops(uint32_t origin, Paths& paths, Scan& res) const
+{
+	// Wave by wave, the latencies of a wave are final before the next.
+	std::vector<uint32_t>& wave = paths.wave;
+	std::vector<uint32_t>& next_wave = paths.next_wave;
+	wave.assign(1, origin);
+	for (uint32_t hops = 1; !wave.empty(); hops++) {
+		next_wave.clear();
+		for (uint32_t v : wave) {
+			for (const Edge *e = begin(v); e != end(v); e++) {
+				uint64_t lat = paths.latency[v] + e->latency;
+				if (reach(paths, e->to)) {
+					paths.hops[e->to] = hops;
+					next_wave.push_back(e->to);
+				} else if (paths.hops[e->to] != hops ||
+					   paths.latency[e->to] <= lat) {
+					continue;
+				}
+				paths.latency[e->to] = lat;
+			}
+		}
+		for (uint32_t v : next_wave)
+			addReached(res, paths, v);
+		std::swap(wave, next_wave);
+	}
+}
+
+void
+Graph::findLeastLatency(uint32_t origin, Paths& paths, Scan& res) const
+{
+	// Latencies are positive, so all the paths of the same latency to a
+	// vertex are relaxed before it is popped and it gets the least hops.
+	RadixHeap& heap = paths.heap;
+	heap.clear();
+	heap.push(0, origin);
+	while (!heap.empty()) {
+		auto [lat, v] = heap.pop();
+		if (lat != paths.latency[v])
+			continue;
+		if (v != origin)
+			addReached(res, paths, v);
+		uint32_t hops = paths.hops[v] + 1;
+		for (const Edge *e = begin(v); e != end(v); e++) {
+			uint64_t next_lat = lat + e->latency;
+			uint64_t& to_lat = paths.latency[e->to];
+			uint32_t& to_hops = paths.hops[e->to];
+			bool fresh = reach(paths, e->to);
+			if (!fresh && (next_lat > to_lat ||
+				       (next_lat == to_lat && hops >= to_hops)))
+				continue;
+			if (fresh || next_lat < to_lat)
+				heap.push(next_lat, e->to);
+			to_lat = next_lat;
+			to_hops = hops;
+		}
+	}
+}
+
+Graph::Scan
+Graph::scan(NodeId origin, PathMetric_t metric, Paths& paths) const
+{
+	uint32_t v = find(origin);
+	if (v == NO_VERTEX)
+		return Scan{};
+	return findPaths(v, metric, paths);
+}
+
+std::pair<uint64_t, uint32_t>
+RadixHeap::pop()
+{
+	if (buckets[0].empty()) {
+		size_t i = 1;
+		while (buckets[i].empty())
+			i++;
+		auto& from = buckets[i];
+		last = std::min_element(from.begin(), from.end())->first;
+		for (const auto& item : from)
+			buckets[bucketOf(item.first)].push_back(item);
+		from.clear();
+	}
+	auto res = buckets[0].back();
+	buckets[0].pop_back();
+	count--;
+	return res;
+}
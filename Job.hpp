@@ -6,14 +6,70 @@
  */
 #pragma once
 
+#include <type_traits>
+
 #include <Scheduler.hpp>
+#include <Traffic.hpp>
 #include <Utils.hpp>
 
+// Jobs that are messages between nodes have MSG_TYPE, from(), to() and
+// wireSize(). Their size is accounted and adds transfer time to delay.
+template <class F, class = void>
+struct IsMessage : std::false_type {};
+
+template <class F>
+struct IsMessage<F, std::void_t<decltype(F::MSG_TYPE)>> : std::true_type {};
+
+inline size_t
+transferDelay(size_t size)
+{
+	return size / LINK_BANDWIDTH;
+}
+
+inline void
+msgSent(NodeId from, NodeId to, Msg_t type, size_t size)
+{
+	Traffic::sent(type, size);
+	Node *node = Cluster::findNode(from);
+	if (node == nullptr)
+		return;
+	node->sent_traffic.add(type, size);
+	Node *peer = Cluster::findNode(to);
+	if (peer != nullptr && peer->dc != node->dc)
+		Traffic::crossDc(type, size);
+	if (node->hasPeer(to))
+		node->getConn(*node->getPeerConns(to).begin()).bytes_sent += size;
+}
+
+inline void
+msgReceived(NodeId from, NodeId to, Msg_t type, size_t size)
+{
+	Node *node = Cluster::findNode(to);
+	if (node == nullptr) {
+		Traffic::wasted(type, size);
+		return;
+	}
+	node->recv_traffic.add(type, size);
+	if (node->hasPeer(from))
+		node->getConn(*node->getPeerConns(from).begin()).bytes_recv += size;
+}
+
 template <class F>
 void
 jobSchedule(F&& f, bool now = false)
 {
-	Scheduler::add(now ? 0 : f.delay(), std::forward<F>(f));
+	using Job_t = std::decay_t<F>;
+	if constexpr (IsMessage<Job_t>::value) {
+		size_t size = f.wireSize();
+		msgSent(f.from(), f.to(), Job_t::MSG_TYPE, size);
+		size_t delay = now ? 0 : f.delay() + transferDelay(size);
+		Scheduler::add(delay, [job = Job_t(std::forward<F>(f)), size]() mutable {
+			msgReceived(job.from(), job.to(), Job_t::MSG_TYPE, size);
+			job();
+		});
+	} else {
+		Scheduler::add(now ? 0 : f.delay(), std::forward<F>(f));
+	}
 }
 
 inline size_t
@@ -23,4 +79,4 @@ pingDelay(NodeId node_id, NodeId peer_id)
 	assert(node != nullptr);
 	Node *peer = Cluster::findNode(peer_id);
 	return node->getLatency(peer);
-}
\ No newline at end of file
+}
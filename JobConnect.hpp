@@ -5,6 +5,8 @@
  */
 #pragma once
 
+#include <vector>
+
 #include <Cluster.hpp>
 #include <Job.hpp>
 #include <Utils.hpp>
@@ -14,6 +16,11 @@ struct JobDisconnectPeer {
 	NodeId peer_id;
 	ConnId conn_id;
 
+	static constexpr Msg_t MSG_TYPE = MSG_DISCONNECT;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const { return wireMsgSize(conn_id); }
+
 	size_t delay() const
 	{
 		return pingDelay(node_id, peer_id);
@@ -25,6 +32,10 @@ struct JobDisconnectPeer {
 		if (peer == nullptr)
 			return;
 		peer->disconnect(conn_id);
+		peer->noteChange();
+		// Partial view membership: a demoted peer stays passive.
+		if (Options::membership == MEMBERSHIP_PARTIAL)
+			peer->addPassive(node_id);
 	}
 };
 
@@ -47,6 +58,7 @@ struct JobDisconnect {
 			return;
 		NodeId peer_id = conns.at(conn_id).getPeerId();
 		node->disconnect(conn_id);
+		node->noteChange();
 		jobSchedule(JobDisconnectPeer{node_id, peer_id, conn_id});
 	}
 };
@@ -57,6 +69,11 @@ struct JobConnectNotifyPeer {
 	ConnId conn_id;
 	size_t time_accept;
 
+	static constexpr Msg_t MSG_TYPE = MSG_CONNECT_ACK;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const { return wireMsgSize(conn_id, time_accept); }
+
 	size_t delay() const
 	{
 		return pingDelay(node_id, peer_id);
@@ -67,11 +84,15 @@ struct JobConnectNotifyPeer {
 		Node *peer = Cluster::findNode(peer_id);
 		if (peer == nullptr || !peer->hasConn(conn_id)) {
 			jobSchedule(JobDisconnect{node_id, conn_id});
+			Node *node = Cluster::findNode(node_id);
+			if (peer == nullptr && node != nullptr)
+				node->markDead(peer_id);
 			return;
 		}
 		size_t time_roundtrip = Scheduler::now() - time_accept;
-		peer->establish(conn_id).latency.update(time_roundtrip);
-		peer->known_direct_latency[node_id].update(time_roundtrip);
+		peer->establish(conn_id);
+		peer->noteChange();
+		peer->updateRtt(node_id, time_roundtrip);
 	}
 };
 
@@ -82,6 +103,14 @@ struct JobConnectNotifyNode {
 	size_t time_start;
 	size_t time_accept;
 
+	static constexpr Msg_t MSG_TYPE = MSG_CONNECT_ACCEPT;
+	NodeId from() const { return peer_id; }
+	NodeId to() const { return node_id; }
+	size_t wireSize() const
+	{
+		return wireMsgSize(conn_id, time_start, time_accept);
+	}
+
 	size_t delay() const
 	{
 		return pingDelay(peer_id, node_id);
@@ -92,21 +121,67 @@ struct JobConnectNotifyNode {
 		Node *node = Cluster::findNode(node_id);
 		if (node == nullptr || !node->hasConn(conn_id)) {
 			jobSchedule(JobDisconnect{peer_id, conn_id});
+			Node *peer = Cluster::findNode(peer_id);
+			if (node == nullptr && peer != nullptr)
+				peer->markDead(node_id);
 			return;
 		}
 		size_t time_roundtrip = Scheduler::now() - time_start;
-		node->establish(conn_id).latency.update(time_roundtrip);
-		node->known_direct_latency[peer_id].update(time_roundtrip);
+		node->establish(conn_id).time_accepted = time_accept;
+		node->noteChange();
+		node->updateRtt(peer_id, time_roundtrip);
 		jobSchedule(JobConnectNotifyPeer{node_id, peer_id,
 						 conn_id, time_accept});
 	}
 };
 
+// Peer refuses a connection as it has too many and offers one of its peers
+// to connect to instead.
+struct JobConnectReject {
+	NodeId node_id;
+	NodeId peer_id;
+	ConnId conn_id;
+	NodeId redirect_id;
+	// Hops of a forwarded join, 0 for other redirects.
+	size_t forward_count;
+
+	static constexpr Msg_t MSG_TYPE = MSG_CONNECT_REJECT;
+	NodeId from() const { return peer_id; }
+	NodeId to() const { return node_id; }
+	size_t wireSize() const
+	{
+		// Redirect is sent as id + 1, 0 if there's none.
+		size_t redirect = redirect_id.isSet() ?
+				  redirect_id.rawID() + 1 : 0;
+		return wireMsgSize(conn_id, redirect, forward_count);
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(peer_id, node_id);
+	}
+
+	void operator()();
+};
+
 struct JobConnectAccept {
 	NodeId node_id;
 	NodeId peer_id;
 	ConnId conn_id;
 	size_t time_start;
+	// Established connections of the node, it is joining if there's none.
+	size_t node_degree;
+	// Times the connect has been forwarded by full active views.
+	size_t forward_count;
+
+	static constexpr Msg_t MSG_TYPE = MSG_CONNECT;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		return wireMsgSize(conn_id, node_id, time_start, node_degree,
+				   forward_count);
+	}
 
 	size_t delay() const
 	{
@@ -116,19 +191,117 @@ struct JobConnectAccept {
 	void operator()()
 	{
 		Node *peer = Cluster::findNode(peer_id);
-		if (peer == nullptr) {
+		if (peer == nullptr || peer->leaving) {
 			jobSchedule(JobDisconnect{node_id, conn_id});
+			Node *node = Cluster::findNode(node_id);
+			if (node != nullptr)
+				node->markDead(peer_id);
 			return;
 		}
+		bool is_crossed = isCrossed(peer);
+		if (is_crossed && peer_id.rawID() < node_id.rawID()) {
+			// The connection of the lesser node wins.
+			Handshakes::wasted_count++;
+			jobSchedule(JobDisconnectPeer{peer_id, node_id,
+						      conn_id});
+			return;
+		}
+		// A crossed connection takes the place of the peer's own one
+		// and needs no admission.
+		if (!is_crossed && !admit(peer))
+			return;
+		if (peer->hasPeer(node_id)) {
+			for (ConnId id : std::vector<ConnId>(
+				     peer->getPeerConns(node_id).begin(),
+				     peer->getPeerConns(node_id).end()))
+				peer->disconnect(id);
+			peer->noteChange();
+		}
 		peer->accept(conn_id, node_id);
 		jobSchedule(JobConnectNotifyNode{node_id, peer_id, conn_id,
 						 time_start, Scheduler::now()});
 	}
+
+	// Admission of the connection by @a peer, a rejected one is answered.
+	bool admit(Node *peer)
+	{
+		// Partial view membership: a full active view forwards the node
+		// to a random peer as HyParView forwards joins. The last one of
+		// the walk makes room for a joining node.
+		if (peer->isViewFull()) {
+			NodeId redirect_id;
+			if (forward_count < FORWARD_WALK_LENGTH)
+				redirect_id = peer->getForward(node_id);
+			if (node_degree != 0 || redirect_id.isSet()) {
+				Admission::reject_count++;
+				jobSchedule(JobConnectReject{node_id, peer_id,
+							     conn_id,
+							     redirect_id,
+							     forward_count + 1});
+				return false;
+			}
+			makeRoom(peer);
+		}
+		// A joining node is never rejected, it might find no one else.
+		if (node_degree != 0 && peer->isOverDegree()) {
+			Admission::reject_count++;
+			jobSchedule(JobConnectReject{node_id, peer_id, conn_id,
+						     peer->getRedirect(node_id),
+						     0});
+			return false;
+		}
+		return true;
+	}
+
+	// Demote a random peer that has other connections to the passive
+	// view, the connection is not made if there's none.
+	void makeRoom(Node *peer)
+	{
+		std::vector<NodeId> peers;
+		peer->getEstablishedPeers(peers);
+		std::vector<NodeId> victims;
+		for (NodeId id : peers) {
+			auto itr = peer->known_nodes.find(id);
+			if (itr != peer->known_nodes.end() &&
+			    itr->second->size() > 1)
+				victims.push_back(id);
+		}
+		if (victims.empty())
+			return;
+		NodeId victim_id = victims[Rnd::choose(victims)];
+		for (ConnId id : std::vector<ConnId>(
+			     peer->getPeerConns(victim_id).begin(),
+			     peer->getPeerConns(victim_id).end())) {
+			peer->disconnect(id);
+			jobSchedule(JobDisconnectPeer{peer_id, victim_id, id});
+		}
+		peer->noteChange();
+		peer->addPassive(victim_id);
+	}
+
+	// The node connects only to peers it has no connection to, so an
+	// outgoing connection of @a peer to it that is pending or that the
+	// node accepted after starting this one has crossed with this one.
+	// Other connections of @a peer to the node are ones that the node
+	// has dropped, they go when this one is accepted.
+	bool isCrossed(Node *peer) const
+	{
+		if (!peer->hasPeer(node_id))
+			return false;
+		for (ConnId id : peer->getPeerConns(node_id)) {
+			const Conn& conn = peer->getConn(id);
+			if (conn.isOutgoing() && (!conn.isEstablished() ||
+						  conn.time_accepted > time_start))
+				return true;
+		}
+		return false;
+	}
 };
 
 struct JobConnect {
 	NodeId node_id;
 	NodeId peer_id;
+	size_t forward_count = 0;
 
 	size_t delay() const
 	{
@@ -140,8 +313,42 @@ struct JobConnect {
 		Node *node = Cluster::findNode(node_id);
 		if (node == nullptr)
 			return;
+		// Infos of both lag behind connects that are underway.
+		if (node->hasPeer(peer_id)) {
+			Handshakes::suppressed_count++;
+			return;
+		}
+		size_t degree = 0;
+		for (const auto& [id, conn] : node->getConns())
+			if (conn.isEstablished())
+				degree++;
 		ConnId conn_id = node->connect(peer_id);
-		jobSchedule(JobConnectAccept{node_id, peer_id,
-					     conn_id, Scheduler::now()});
+		jobSchedule(JobConnectAccept{node_id, peer_id, conn_id,
+					     Scheduler::now(), degree,
+					     forward_count});
 	}
 };
+
+void
+JobConnectReject::operator()()
+{
+	Node *node = Cluster::findNode(node_id);
+	if (node == nullptr)
+		return;
+	if (node->hasConn(conn_id)) {
+		node->disconnect(conn_id);
+		node->noteChange();
+	}
+	node->rejected_time[peer_id] = Scheduler::now();
+	node->topology_memo = TopologyMemo{};
+	// Partial view membership: the peer is alive, just full.
+	if (Options::membership == MEMBERSHIP_PARTIAL)
+		node->addPassive(peer_id);
+	// Forwarded joins are bounded by the walk length, not by backoff.
+	if (!redirect_id.isSet() || node->leaving || redirect_id == node_id ||
+	    node->hasPeer(redirect_id) ||
+	    (forward_count == 0 && node->isRejecting(redirect_id)))
+		return;
+	Admission::redirect_count++;
+	jobSchedule(JobConnect{node_id, redirect_id, forward_count});
+}
@@ -5,14 +5,70 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+
 #include <Cluster.hpp>
 #include <Job.hpp>
+#include <JobPlumtree.hpp>
+#include <Options.hpp>
 #include <Utils.hpp>
 
 struct JobGossipSend {
 	NodeId node_id;
 	NodeId peer_id;
-	std::unordered_map<NodeId, KnownInfoNode> knowledge;
+	// Encoded knowledge, shared by all the sends of one gossip round.
+	std::shared_ptr<const std::vector<uint8_t>> payload;
+	Piggyback piggyback;
+
+	static constexpr Msg_t MSG_TYPE = MSG_GOSSIP;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		return wireMsgSize(node_id, piggyback.time_sent,
+				   piggyback.echo_time) +
+		       wireBytesSize(payload->size());
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(node_id, peer_id);
+	}
+
+	void operator()()
+	{
+		Node *peer = Cluster::findNode(peer_id);
+		if (peer == nullptr)
+			return;
+
+		peer->takePiggyback(node_id, piggyback,
+				    transferDelay(wireSize()));
+		peer->applyKnowledge(*payload);
+	}
+};
+
+// Request of known infos of given origins, peer replies with JobGossipSend.
+struct JobGossipPull {
+	NodeId node_id;
+	NodeId peer_id;
+	// Sorted by id.
+	std::vector<NodeId> origins;
+
+	static constexpr Msg_t MSG_TYPE = MSG_GOSSIP_PULL;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		size_t res = wireMsgSize(node_id, origins.size());
+		size_t prev = 0;
+		for (NodeId origin : origins) {
+			res += varintSize(origin.rawID() - prev);
+			prev = origin.rawID();
+		}
+		return res;
+	}
 
 	size_t delay() const
 	{
@@ -25,7 +81,164 @@ struct JobGossipSend {
 		if (peer == nullptr)
 			return;
 
-		peer->applyKnowledge(knowledge);
+		std::vector<const KnownInfoNode *> infos;
+		for (NodeId origin : origins) {
+			auto itr = peer->known_nodes.find(origin);
+			if (itr != peer->known_nodes.end())
+				infos.push_back(&*itr->second);
+		}
+		if (infos.empty())
+			return;
+		auto payload = std::make_shared<std::vector<uint8_t>>();
+		encodeKnowledge(infos, *payload);
+		jobSchedule(JobGossipSend{peer_id, node_id, std::move(payload),
+					  peer->makePiggyback(node_id)});
+	}
+};
+
+// Versions that peer knows in the buckets that differ from node's digest.
+// Node pushes what is newer on its side and pulls what is newer on peer's.
+struct JobGossipDigestReply {
+	NodeId node_id;
+	NodeId peer_id;
+	// Sorted.
+	std::vector<size_t> buckets;
+	// Stamps, sorted by origin id.
+	std::vector<std::pair<NodeId, size_t>> versions;
+
+	static constexpr Msg_t MSG_TYPE = MSG_GOSSIP_DIGEST_REPLY;
+	NodeId from() const { return peer_id; }
+	NodeId to() const { return node_id; }
+	size_t wireSize() const
+	{
+		size_t res = wireMsgSize(peer_id, buckets.size(),
+					 versions.size());
+		size_t prev = 0;
+		for (size_t bucket : buckets) {
+			res += varintSize(bucket - prev);
+			prev = bucket;
+		}
+		prev = 0;
+		for (auto [origin, stamp] : versions) {
+			res += varintSize(origin.rawID() - prev);
+			res += varintSize(stamp);
+			prev = origin.rawID();
+		}
+		return res;
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(peer_id, node_id);
+	}
+
+	void operator()()
+	{
+		Node *node = Cluster::findNode(node_id);
+		if (node == nullptr)
+			return;
+
+		auto by_origin = [](const auto& a, const auto& b) {
+			return a.first.rawID() < b.first.rawID();
+		};
+		std::vector<const KnownInfoNode *> push;
+		for (const auto& [origin, info] : node->known_nodes) {
+			if (!std::binary_search(buckets.begin(), buckets.end(),
+						digestBucket(origin)))
+				continue;
+			std::pair<NodeId, size_t> key{origin, 0};
+			auto itr = std::lower_bound(versions.begin(),
+						    versions.end(),
+						    key, by_origin);
+			if (itr == versions.end() || itr->first != origin ||
+			    itr->second < info->stamp())
+				push.push_back(&*info);
+		}
+		std::vector<NodeId> pull;
+		for (auto [origin, stamp] : versions) {
+			auto itr = node->known_nodes.find(origin);
+			if (itr == node->known_nodes.end() ||
+			    itr->second->stamp() < stamp)
+				pull.push_back(origin);
+		}
+
+		if (!push.empty()) {
+			auto payload = std::make_shared<std::vector<uint8_t>>();
+			encodeKnowledge(push, *payload);
+			jobSchedule(JobGossipSend{node_id, peer_id,
+						  std::move(payload),
+						  node->makePiggyback(peer_id)});
+		}
+		if (!pull.empty())
+			jobSchedule(JobGossipPull{node_id, peer_id,
+						  std::move(pull)});
+	}
+};
+
+// Hashes of node's known versions by buckets of node ids.
+struct JobGossipDigest {
+	NodeId node_id;
+	NodeId peer_id;
+	// Sorted by bucket, shared by all the sends of one gossip round.
+	std::shared_ptr<const std::vector<std::pair<size_t, uint64_t>>> digest;
+
+	static constexpr Msg_t MSG_TYPE = MSG_GOSSIP_DIGEST;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		size_t res = wireMsgSize(node_id, digest->size());
+		size_t prev = 0;
+		for (auto [bucket, hash] : *digest) {
+			res += varintSize(bucket - prev) + sizeof(hash);
+			prev = bucket;
+		}
+		return res;
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(node_id, peer_id);
+	}
+
+	void operator()()
+	{
+		Node *peer = Cluster::findNode(peer_id);
+		if (peer == nullptr)
+			return;
+
+		std::vector<size_t> buckets;
+		for (auto [bucket, hash] : *digest) {
+			auto itr = peer->digest_buckets.find(bucket);
+			if (itr == peer->digest_buckets.end() ||
+			    itr->second != hash)
+				buckets.push_back(bucket);
+		}
+		std::pair<size_t, uint64_t> key;
+		for (auto [bucket, hash] : peer->digest_buckets) {
+			key.first = bucket;
+			auto itr = std::lower_bound(digest->begin(),
+						    digest->end(), key);
+			if (itr == digest->end() || itr->first != bucket)
+				buckets.push_back(bucket);
+		}
+		if (buckets.empty())
+			return;
+		std::sort(buckets.begin(), buckets.end());
+
+		std::vector<std::pair<NodeId, size_t>> versions;
+		for (const auto& [origin, info] : peer->known_nodes) {
+			if (std::binary_search(buckets.begin(), buckets.end(),
+					       digestBucket(origin)))
+				versions.emplace_back(origin, info->stamp());
+		}
+		std::sort(versions.begin(), versions.end(),
+			  [](const auto& a, const auto& b) {
+			return a.first.rawID() < b.first.rawID();
+		});
+		jobSchedule(JobGossipDigestReply{node_id, peer_id,
+						 std::move(buckets),
+						 std::move(versions)});
 	}
 };
 
@@ -38,17 +251,185 @@ struct JobGossip {
 		return GOSSIP_INTERVAL * rnd;
 	}
 
+	// What is sent in one gossip round, created on demand.
+	struct Round {
+		std::shared_ptr<const std::vector<uint8_t>> payload;
+		std::shared_ptr<const std::vector<std::pair<size_t, uint64_t>>> digest;
+		// Cross-DC summaries by receiver's DC.
+		std::shared_ptr<const std::vector<uint8_t>> summaries[NUM_DC];
+		// Bridge elections by receiver's DC, held once per round.
+		bool is_elected[NUM_DC] = {};
+		bool is_bridge[NUM_DC] = {};
+	};
+
+	bool isBridge(Node *node, size_t peer_dc, Round& round)
+	{
+		if (!round.is_elected[peer_dc]) {
+			round.is_bridge[peer_dc] = node->isDcBridge(peer_dc);
+			round.is_elected[peer_dc] = true;
+			// A bridge elected again starts with the whole state.
+			if (!round.is_bridge[peer_dc])
+				node->dc_summary_sent[peer_dc].clear();
+		}
+		return round.is_bridge[peer_dc];
+	}
+
+	void send(Node *node, NodeId peer_id, Round& round)
+	{
+		if (Options::membership == MEMBERSHIP_PARTIAL) {
+			// Only own and peers' infos, peers learn their 2 hops.
+			if (round.payload == nullptr) {
+				std::vector<const KnownInfoNode *> infos;
+				node->getNeighborhood(infos);
+				auto payload = std::make_shared<std::vector<uint8_t>>();
+				encodeKnowledge(infos, *payload);
+				round.payload = std::move(payload);
+			}
+			jobSchedule(JobGossipSend{node_id, peer_id, round.payload,
+						  node->makePiggyback(peer_id)});
+		} else if (Options::gossip_mode == GOSSIP_DIGEST) {
+			if (round.digest == nullptr) {
+				auto digest = std::make_shared<std::vector<std::pair<size_t, uint64_t>>>();
+				node->getDigest(*digest);
+				round.digest = std::move(digest);
+			}
+			jobSchedule(JobGossipDigest{node_id, peer_id, round.digest});
+		} else {
+			if (round.payload == nullptr) {
+				auto payload = std::make_shared<std::vector<uint8_t>>();
+				encodeKnowledge(node->known_nodes, *payload);
+				round.payload = std::move(payload);
+			}
+			jobSchedule(JobGossipSend{node_id, peer_id, round.payload,
+						  node->makePiggyback(peer_id)});
+		}
+	}
+
+	// Infos of nodes out of peer's DC that have changed since the last
+	// summary to that DC, the DC spreads them and its own infos itself.
+	// Nothing is sent if there are no changes.
+	void sendDcSummary(Node *node, NodeId peer_id, size_t peer_dc,
+			   Round& round)
+	{
+		auto& summary = round.summaries[peer_dc];
+		if (summary == nullptr) {
+			auto& prev = node->dc_summary_sent[peer_dc];
+			std::unordered_map<NodeId, size_t> sent;
+			std::vector<const KnownInfoNode *> infos;
+			for (const auto& [origin, info] : node->known_nodes) {
+				if (!info->dead && info->dc == peer_dc)
+					continue;
+				sent.emplace(origin, info->stamp());
+				auto itr = prev.find(origin);
+				if (itr == prev.end() ||
+				    itr->second != info->stamp())
+					infos.push_back(&*info);
+			}
+			prev = std::move(sent);
+			auto payload = std::make_shared<std::vector<uint8_t>>();
+			if (!infos.empty())
+				encodeKnowledge(infos, *payload);
+			summary = std::move(payload);
+		}
+		if (summary->empty())
+			return;
+		jobSchedule(JobGossipSend{node_id, peer_id, summary,
+					  node->makePiggyback(peer_id)});
+	}
+
+	static bool hasPeerInDc(const Node *node)
+	{
+		for (const auto& [conn_id, conn] : node->getConns())
+			if (node->getKnownDc(conn.getPeerId()) == node->dc)
+				return true;
+		return false;
+	}
+
+	void plumtreeRound(Node *node)
+	{
+		if (!node->plumtree_outbox.empty()) {
+			std::vector<KnownInfoRef> infos;
+			std::swap(infos, node->plumtree_outbox);
+			plumtreeForward(node, node_id, infos);
+		}
+		for (auto& [peer_id, ids] : node->ihave_queue) {
+			if (node->hasPeer(peer_id))
+				jobSchedule(JobPlumtreeIHave{node_id, peer_id,
+							     std::move(ids)});
+		}
+		node->ihave_queue.clear();
+
+		// Anti-entropy with a random peer repairs what the trees lost.
+		if (++node->gossip_round % PLUMTREE_ANTI_ENTROPY_ROUNDS != 0)
+			return;
+		std::vector<NodeId> peers;
+		node->getPeers(peers);
+		if (peers.empty())
+			return;
+		auto digest = std::make_shared<std::vector<std::pair<size_t, uint64_t>>>();
+		node->getDigest(*digest);
+		jobSchedule(JobGossipDigest{node_id, peers[Rnd::choose(peers)],
+					    std::move(digest)});
+	}
+
+	// Whether it is time for a round, with adaptive cadence the interval
+	// is reset by changes and doubles while there are none.
+	static bool isRoundDue(Node *node)
+	{
+		if (Options::gossip_cadence == GOSSIP_CADENCE_FIXED) {
+			node->gossip_interval = GOSSIP_INTERVAL;
+			return true;
+		}
+		if (node->knowledge_changed) {
+			node->gossip_interval = GOSSIP_INTERVAL;
+			return true;
+		}
+		if (Scheduler::now() < node->last_gossip + node->gossip_interval)
+			return false;
+		node->gossip_interval = std::min(2 * node->gossip_interval,
+						 GOSSIP_INTERVAL_MAX);
+		return true;
+	}
+
 	void operator()()
 	{
 		Node *node = Cluster::findNode(node_id);
-		if (node == nullptr)
+		if (node == nullptr || node->leaving)
 			return;
 		jobSchedule(*this);
+		if (!isRoundDue(node))
+			return;
+		node->evictTombstones();
+		node->prepageKnowledge();
+		node->last_gossip = Scheduler::now();
+		node->knowledge_changed = false;
+		Propagation::round_count++;
+		if (Options::usePlumtree()) {
+			plumtreeRound(node);
+			return;
+		}
+		if (Options::membership == MEMBERSHIP_PARTIAL)
+			node->prunePartialKnowledge();
 
-		auto knowledge = node->prepageKnowledge();
-		const auto& conns = node->getConns();
-		for (const auto& [conn_id, conn] : conns)
-			jobSchedule(JobGossipSend{node_id, conn.getPeerId(),
-						  knowledge});
+		// A node without peers in own DC has nobody else to tell.
+		bool by_dc = Options::gossip_scope == GOSSIP_SCOPE_DC &&
+			     hasPeerInDc(node);
+		bool cross_dc_round = by_dc && Scheduler::now() >=
+			node->last_cross_dc_gossip + CROSS_DC_GOSSIP_INTERVAL;
+		if (cross_dc_round)
+			node->last_cross_dc_gossip = Scheduler::now();
+
+		Round round;
+		for (const auto& [conn_id, conn] : node->getConns()) {
+			NodeId peer_id = conn.getPeerId();
+			size_t peer_dc = node->getKnownDc(peer_id);
+			if (by_dc && peer_dc != node->dc) {
+				if (cross_dc_round &&
+				    isBridge(node, peer_dc, round))
+					sendDcSummary(node, peer_id, peer_dc, round);
+				continue;
+			}
+			send(node, peer_id, round);
+		}
 	}
-};
\ No newline at end of file
+};
@@ -5,16 +5,46 @@
  */
 #pragma once
 
+#include <algorithm>
+
 #include <Cluster.hpp>
 #include <Job.hpp>
 #include <JobConnect.hpp>
 #include <Utils.hpp>
 
+// Drop connections of @a node_id to @a peer_id that is suspected dead.
+inline void
+dropPeer(NodeId node_id, NodeId peer_id)
+{
+	Node *node = Cluster::findNode(node_id);
+	if (node == nullptr)
+		return;
+	if (node->hasPeer(peer_id)) {
+		for (ConnId conn_id : node->getPeerConns(peer_id))
+			jobSchedule(JobDisconnect{node_id, conn_id});
+	}
+	node->markDead(peer_id);
+}
+
+// Heartbeats are per peer, an RTT sample applies to all the connections.
+// With latency_estimate coords the peer replies with its coordinate, the
+// sample moves the own one relative to it.
 struct JobHeartbeatBack {
 	NodeId node_id;
 	NodeId peer_id;
-	ConnId conn_id;
 	size_t time_start;
+	NetCoord peer_coord;
+
+	static constexpr Msg_t MSG_TYPE = MSG_HEARTBEAT_PONG;
+	NodeId from() const { return peer_id; }
+	NodeId to() const { return node_id; }
+	size_t wireSize() const
+	{
+		size_t res = wireMsgSize(peer_id, time_start);
+		if (Options::latency_estimate == LATENCY_ESTIMATE_COORDS)
+			res += coordWireSize(peer_coord);
+		return res;
+	}
 
 	size_t delay() const
 	{
@@ -24,23 +54,27 @@ struct JobHeartbeatBack {
 	void operator()()
 	{
 		Node *node = Cluster::findNode(node_id);
-		if (node == nullptr) {
-			jobSchedule(JobDisconnect{peer_id, conn_id});
+		if (node == nullptr)
 			return;
-		}
-		size_t latency = Scheduler::now() - time_start;
-		if (node->hasConn(conn_id))
-			node->getConn(conn_id).latency.update(latency);
-		node->known_direct_latency[peer_id].update(latency);
+		double rtt = Scheduler::now() - time_start;
+		node->updateRtt(peer_id, rtt);
+		if (Options::latency_estimate != LATENCY_ESTIMATE_COORDS)
+			return;
+		node->coord.update(peer_coord, rtt);
+		node->noteLatencyChange();
 	}
 };
 
 struct JobHeartbeatForth {
 	NodeId node_id;
 	NodeId peer_id;
-	ConnId conn_id;
 	size_t time_start = Scheduler::now();
 
+	static constexpr Msg_t MSG_TYPE = MSG_HEARTBEAT_PING;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const { return wireMsgSize(node_id, time_start); }
+
 	size_t delay() const
 	{
 		return pingDelay(node_id, peer_id);
@@ -49,36 +83,94 @@ struct JobHeartbeatForth {
 	void operator()()
 	{
 		Node *peer = Cluster::findNode(peer_id);
-		if (peer == nullptr) {
-			jobSchedule(JobDisconnect{node_id, conn_id});
+		if (peer == nullptr)
 			return;
-		}
-		jobSchedule(JobHeartbeatBack{node_id, peer_id,
-					     conn_id, time_start});
+		jobSchedule(JobHeartbeatBack{node_id, peer_id, time_start,
+					     peer->coord});
 	}
 
 };
 
+// Probing interval of @a conn to @a peer_id: the base one while the
+// connection is new, jittery or suspected, longer as it stays steady.
+inline size_t
+heartbeatInterval(const Node *node, NodeId peer_id, Conn& conn)
+{
+	if (Options::heartbeat_cadence == HEARTBEAT_CADENCE_FIXED)
+		return HEARTBEAT_INTERVAL;
+	if (conn.steady_count == 0 ||
+	    node->getPhi(peer_id) > PHI_THRESHOLD / 2)
+		return HEARTBEAT_INTERVAL;
+	if (conn.steady_count < HEARTBEAT_STABLE_SAMPLES)
+		return conn.heartbeat_interval;
+	// Still steady, but the next doubling takes as many samples again.
+	conn.steady_count = 1;
+	size_t max_interval = std::max(HEARTBEAT_INTERVAL,
+				       Options::detection_budget /
+				       HEARTBEAT_BUDGET_SHARE);
+	return std::min(2 * conn.heartbeat_interval, max_interval);
+}
+
+// Wakes up at the nearest deadline of connections of a node and probes
+// those that are due.
 struct JobHeartbeat {
 	NodeId node_id;
+	size_t wait = HEARTBEAT_INTERVAL;
 
 	size_t delay() const
 	{
 		double rnd = Rnd::getPessimistLogNormal(INTERVAL_RANDOM_COEF);
-		return HEARTBEAT_INTERVAL * rnd;
+		return wait * rnd;
 	}
 
 	void operator()()
 	{
 		Node *node = Cluster::findNode(node_id);
-		if (node == nullptr)
+		if (node == nullptr || node->leaving)
 			return;
-		jobSchedule(*this);
 
-		const auto& conns = node->getConns();
-		for (const auto& [conn_id, conn] : conns)
-			jobSchedule(JobHeartbeatForth{node_id,
-						      conn.getPeerId(),
-						      conn_id});
+		// Failure detection is up to phi-accrual, nobody reports that
+		// a node is gone.
+		std::vector<NodeId> suspects;
+		for (const auto& [peer_id, conns] : node->getPeersRaw())
+			if (node->getPhi(peer_id) > PHI_THRESHOLD)
+				suspects.push_back(peer_id);
+		for (NodeId peer_id : suspects) {
+			FailureDetection::suspect(peer_id);
+			dropPeer(node_id, peer_id);
+		}
+
+		// No probe if a fresh sample came with other messages.
+		size_t now = Scheduler::now();
+		size_t next = now + HEARTBEAT_INTERVAL;
+		for (const auto& [peer_id, conns] : node->getPeersRaw()) {
+			auto itr = node->last_rtt_time.find(peer_id);
+			size_t last_rtt = itr != node->last_rtt_time.end() ?
+					  itr->second : 0;
+			bool probed = false;
+			for (ConnId conn_id : conns) {
+				Conn& conn = node->getConn(conn_id);
+				if (conn.heartbeat_deadline <= now) {
+					conn.heartbeat_interval =
+						heartbeatInterval(node, peer_id,
+								  conn);
+					size_t interval = conn.heartbeat_interval;
+					if (last_rtt + interval > now) {
+						conn.heartbeat_deadline =
+							last_rtt + interval;
+					} else {
+						if (!probed)
+							jobSchedule(JobHeartbeatForth{
+								node_id, peer_id});
+						probed = true;
+						conn.heartbeat_deadline =
+							now + interval;
+					}
+				}
+				next = std::min(next, conn.heartbeat_deadline);
+			}
+		}
+		wait = next - now;
+		jobSchedule(*this);
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,118 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <Cluster.hpp>
+#include <Job.hpp>
+#include <JobConnect.hpp>
+#include <Utils.hpp>
+
+// Graceful departure: a leaving node closes its connections, says farewell
+// to its peers with its own tombstone and a replacement peer for each,
+// waits for messages in flight and is removed.
+
+// Node tells peer that it leaves and suggests a replacement peer.
+struct JobFarewell {
+	NodeId node_id;
+	NodeId peer_id;
+	NodeId replacement_id;
+	KnownInfoRef tombstone;
+
+	static constexpr Msg_t MSG_TYPE = MSG_FAREWELL;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		return wireMsgSize(node_id, tombstone->info_version,
+				   tombstone->dead_time, replacement_id);
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(node_id, peer_id);
+	}
+
+	void operator()()
+	{
+		Node *peer = Cluster::findNode(peer_id);
+		if (peer == nullptr || peer->leaving)
+			return;
+
+		if (peer->hasPeer(node_id)) {
+			std::vector<ConnId> conns(peer->getPeerConns(node_id).begin(),
+						  peer->getPeerConns(node_id).end());
+			for (ConnId conn_id : conns)
+				peer->disconnect(conn_id);
+			peer->noteChange();
+		}
+		peer->setTombstone(KnownInfoRef(tombstone));
+		if (replacement_id != peer_id && !peer->hasPeer(replacement_id))
+			jobSchedule(JobConnect{peer_id, replacement_id});
+	}
+};
+
+struct JobLeaveFinish {
+	NodeId node_id;
+
+	size_t delay() const
+	{
+		return FAREWELL_INTERVAL;
+	}
+
+	void operator()()
+	{
+		if (Cluster::findNode(node_id) == nullptr)
+			return;
+		Cluster::delNode(node_id);
+	}
+};
+
+struct JobLeave {
+	NodeId node_id;
+
+	size_t delay() const
+	{
+		return 0;
+	}
+
+	void operator()()
+	{
+		Node *node = Cluster::findNode(node_id);
+		if (node == nullptr || node->leaving)
+			return;
+		node->leaving = true;
+
+		KnownInfoRef tombstone =
+			KnowledgeStore::internTombstone(node_id,
+							node->self_info_version,
+							Scheduler::now());
+		Propagation::issued_count++;
+
+		// Peers are handed over in a ring, so they stay connected.
+		std::vector<NodeId> peers;
+		node->getEstablishedPeers(peers);
+		std::sort(peers.begin(), peers.end(), [](NodeId a, NodeId b) {
+			return a.rawID() < b.rawID();
+		});
+		for (size_t i = 0; i < peers.size(); i++) {
+			NodeId replacement_id = peers[(i + 1) % peers.size()];
+			jobSchedule(JobFarewell{node_id, peers[i],
+						replacement_id, tombstone});
+		}
+
+		// Farewell closes established connections on the other side,
+		// pending handshakes fail there as the connection is gone.
+		std::vector<ConnId> conns;
+		for (const auto& [conn_id, conn] : node->getConns())
+			conns.push_back(conn_id);
+		for (ConnId conn_id : conns)
+			node->disconnect(conn_id);
+		jobSchedule(JobLeaveFinish{node_id});
+	}
+};
@@ -0,0 +1,292 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <algorithm>
+#include <memory>
+
+#include <Cluster.hpp>
+#include <Job.hpp>
+#include <Utils.hpp>
+
+// Plumtree: updates are pushed to eager peers that form spanning trees of
+// the connection graph, and only announced to lazy peers. A duplicate
+// makes its sender lazy, an update that was announced but has not arrived
+// in time is grafted from the announcer, which becomes eager.
+// There's a tree per origin, so it is the tree of the fastest paths from
+// the origin.
+
+// Lazy state is kept in connections to the peer, so a peer is eager
+// again when it reconnects.
+inline bool
+plumtreeIsLazy(const Node *node, NodeId origin, NodeId peer_id)
+{
+	if (!node->hasPeer(peer_id))
+		return false;
+	for (ConnId conn_id : node->getPeerConns(peer_id))
+		if (node->getConn(conn_id).lazy_origins.count(origin) != 0)
+			return true;
+	return false;
+}
+
+inline void
+plumtreeSetLazy(Node *node, NodeId origin, NodeId peer_id)
+{
+	if (!node->hasPeer(peer_id))
+		return;
+	for (ConnId conn_id : node->getPeerConns(peer_id))
+		node->getConn(conn_id).lazy_origins.insert(origin);
+}
+
+inline void
+plumtreeSetEager(Node *node, NodeId origin, NodeId peer_id)
+{
+	if (!node->hasPeer(peer_id))
+		return;
+	for (ConnId conn_id : node->getPeerConns(peer_id))
+		node->getConn(conn_id).lazy_origins.erase(origin);
+}
+
+// Push @a infos that @a node got from @a from_id (or issued itself) to
+// its eager peers and queue announcements for the lazy ones.
+void plumtreeForward(Node *node, NodeId from_id,
+		     const std::vector<KnownInfoRef>& infos);
+
+// Node asks peer to stop pushing updates of given origins.
+struct JobPlumtreePrune {
+	NodeId node_id;
+	NodeId peer_id;
+	std::vector<NodeId> origins;
+
+	static constexpr Msg_t MSG_TYPE = MSG_PRUNE;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		size_t res = wireMsgSize(node_id, origins.size());
+		for (NodeId origin : origins)
+			res += varintSize(origin.rawID());
+		return res;
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(node_id, peer_id);
+	}
+
+	void operator()()
+	{
+		Node *peer = Cluster::findNode(peer_id);
+		if (peer == nullptr)
+			return;
+
+		for (NodeId origin : origins)
+			plumtreeSetLazy(peer, origin, node_id);
+	}
+};
+
+struct JobPlumtreePush {
+	NodeId node_id;
+	NodeId peer_id;
+	// Encoded knowledge, shared by all the pushes of the same infos.
+	std::shared_ptr<const std::vector<uint8_t>> payload;
+
+	static constexpr Msg_t MSG_TYPE = MSG_GOSSIP;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		return wireMsgSize(node_id) + wireBytesSize(payload->size());
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(node_id, peer_id);
+	}
+
+	void operator()()
+	{
+		Node *peer = Cluster::findNode(peer_id);
+		if (peer == nullptr)
+			return;
+
+		std::vector<KnownInfoRef> fresh;
+		std::vector<NodeId> duplicates;
+		auto is_needed = [this, peer, &duplicates](NodeId origin,
+							    size_t stamp) {
+			auto itr = peer->known_nodes.find(origin);
+			if (itr == peer->known_nodes.end() ||
+			    itr->second->stamp() < stamp)
+				return true;
+			plumtreeSetLazy(peer, origin, node_id);
+			duplicates.push_back(origin);
+			return false;
+		};
+		auto apply = [this, peer, &fresh](KnownInfoRef&& info) {
+			if (!peer->setKnownInfo(KnownInfoRef(info)))
+				return;
+			plumtreeSetEager(peer, info->origin, node_id);
+			fresh.push_back(std::move(info));
+		};
+		Propagation::copy_count +=
+			decodeKnowledge(*payload, is_needed, apply);
+
+		if (!duplicates.empty())
+			jobSchedule(JobPlumtreePrune{peer_id, node_id,
+						     std::move(duplicates)});
+		if (!fresh.empty())
+			plumtreeForward(peer, node_id, fresh);
+	}
+};
+
+// Node asks peer to push the info of origin and to become eager for it.
+struct JobPlumtreeGraft {
+	NodeId node_id;
+	NodeId peer_id;
+	NodeId origin;
+
+	static constexpr Msg_t MSG_TYPE = MSG_GRAFT;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		return wireMsgSize(node_id, origin);
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(node_id, peer_id);
+	}
+
+	void operator()()
+	{
+		Node *peer = Cluster::findNode(peer_id);
+		if (peer == nullptr)
+			return;
+
+		plumtreeSetEager(peer, origin, node_id);
+		auto itr = peer->known_nodes.find(origin);
+		if (itr == peer->known_nodes.end())
+			return;
+		std::vector<const KnownInfoNode *> infos{&*itr->second};
+		auto payload = std::make_shared<std::vector<uint8_t>>();
+		encodeKnowledge(infos, *payload);
+		jobSchedule(JobPlumtreePush{peer_id, node_id,
+					    std::move(payload)});
+	}
+};
+
+// Wait for an announced info, graft it from the next announcer if it is
+// still missing.
+struct JobPlumtreeGraftTimer {
+	NodeId node_id;
+	NodeId origin;
+	size_t stamp;
+
+	size_t delay() const
+	{
+		return GRAFT_TIMEOUT;
+	}
+
+	void operator()()
+	{
+		Node *node = Cluster::findNode(node_id);
+		if (node == nullptr)
+			return;
+
+		auto itr = node->missing_infos.find(origin);
+		if (itr == node->missing_infos.end() ||
+		    itr->second.stamp != stamp)
+			return;
+		auto kitr = node->known_nodes.find(origin);
+		if ((kitr != node->known_nodes.end() &&
+		     kitr->second->stamp() >= stamp) ||
+		    itr->second.announcers.empty()) {
+			node->missing_infos.erase(itr);
+			return;
+		}
+		NodeId peer_id = itr->second.announcers.front();
+		itr->second.announcers.pop_front();
+		plumtreeSetEager(node, origin, peer_id);
+		jobSchedule(JobPlumtreeGraft{node_id, peer_id, origin});
+		jobSchedule(*this);
+	}
+};
+
+// Announcement of infos: pairs of origin and stamp.
+struct JobPlumtreeIHave {
+	NodeId node_id;
+	NodeId peer_id;
+	std::vector<std::pair<NodeId, size_t>> ids;
+
+	static constexpr Msg_t MSG_TYPE = MSG_IHAVE;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		size_t res = wireMsgSize(node_id, ids.size());
+		for (auto [origin, stamp] : ids)
+			res += varintSize(origin.rawID()) + varintSize(stamp);
+		return res;
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(node_id, peer_id);
+	}
+
+	void operator()()
+	{
+		Node *peer = Cluster::findNode(peer_id);
+		if (peer == nullptr)
+			return;
+
+		for (auto [origin, stamp] : ids) {
+			auto itr = peer->known_nodes.find(origin);
+			if (itr != peer->known_nodes.end() &&
+			    itr->second->stamp() >= stamp)
+				continue;
+			auto [mitr, inserted] =
+				peer->missing_infos.try_emplace(origin);
+			MissingInfo& missing = mitr->second;
+			if (!inserted && missing.stamp > stamp)
+				continue;
+			if (inserted || missing.stamp < stamp) {
+				missing.stamp = stamp;
+				missing.announcers.clear();
+				jobSchedule(JobPlumtreeGraftTimer{peer_id,
+								  origin,
+								  stamp});
+			}
+			missing.announcers.push_back(node_id);
+		}
+	}
+};
+
+void
+plumtreeForward(Node *node, NodeId from_id,
+		const std::vector<KnownInfoRef>& infos)
+{
+	std::vector<const KnownInfoNode *> eager;
+	for (const auto& [peer_id, conns] : node->getPeersRaw()) {
+		if (peer_id == from_id)
+			continue;
+		eager.clear();
+		for (const KnownInfoRef& info : infos) {
+			if (plumtreeIsLazy(node, info->origin, peer_id))
+				node->ihave_queue[peer_id].emplace_back(
+					info->origin, info->stamp());
+			else
+				eager.push_back(&*info);
+		}
+		if (eager.empty())
+			continue;
+		auto payload = std::make_shared<std::vector<uint8_t>>();
+		encodeKnowledge(eager, *payload);
+		jobSchedule(JobPlumtreePush{node->getId(), peer_id,
+					    std::move(payload)});
+	}
+}
@@ -0,0 +1,126 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <memory>
+
+#include <Cluster.hpp>
+#include <Job.hpp>
+#include <JobConnect.hpp>
+#include <Utils.hpp>
+
+// Partial view membership: nodes periodically exchange random samples of
+// their active and passive views, together with infos of the nodes.
+
+inline void
+getShuffleSample(Node *node, std::vector<uint8_t>& payload)
+{
+	std::vector<NodeId> ids;
+	node->getPeers(ids);
+	ids.insert(ids.end(), node->passive_view.begin(),
+		   node->passive_view.end());
+	std::vector<const KnownInfoNode *> infos;
+	infos.push_back(&*node->known_nodes.at(node->getId()));
+	while (!ids.empty() && infos.size() < SHUFFLE_SIZE) {
+		size_t i = Rnd::choose(ids);
+		auto itr = node->known_nodes.find(ids[i]);
+		if (itr != node->known_nodes.end() && !itr->second->dead)
+			infos.push_back(&*itr->second);
+		ids[i] = ids.back();
+		ids.pop_back();
+	}
+	encodeKnowledge(infos, payload);
+}
+
+struct JobShuffleSend {
+	NodeId node_id;
+	NodeId peer_id;
+	std::shared_ptr<const std::vector<uint8_t>> payload;
+	bool need_reply;
+
+	static constexpr Msg_t MSG_TYPE = MSG_SHUFFLE;
+	NodeId from() const { return node_id; }
+	NodeId to() const { return peer_id; }
+	size_t wireSize() const
+	{
+		return wireMsgSize(node_id, need_reply) +
+		       wireBytesSize(payload->size());
+	}
+
+	size_t delay() const
+	{
+		return pingDelay(node_id, peer_id);
+	}
+
+	void operator()()
+	{
+		Node *peer = Cluster::findNode(peer_id);
+		if (peer == nullptr)
+			return;
+
+		if (need_reply) {
+			auto reply = std::make_shared<std::vector<uint8_t>>();
+			getShuffleSample(peer, *reply);
+			jobSchedule(JobShuffleSend{peer_id, node_id,
+						   std::move(reply), false});
+		}
+
+		auto is_needed = [](NodeId, size_t) { return true; };
+		auto apply = [peer](KnownInfoRef&& info) {
+			NodeId origin = info->origin;
+			auto itr = peer->known_nodes.find(origin);
+			if (itr == peer->known_nodes.end() ||
+			    itr->second->stamp() < info->stamp())
+				peer->setKnownInfo(std::move(info));
+			peer->addPassive(origin);
+		};
+		decodeKnowledge(*payload, is_needed, apply);
+	}
+};
+
+// Runs on every node, shuffles only while membership is partial, so the
+// option can be switched at any time.
+struct JobShuffle {
+	NodeId node_id;
+
+	size_t delay() const
+	{
+		if (Options::membership != MEMBERSHIP_PARTIAL)
+			return SHUFFLE_INTERVAL;
+		double rnd = Rnd::getPessimistLogNormal(INTERVAL_RANDOM_COEF);
+		return SHUFFLE_INTERVAL * rnd;
+	}
+
+	void operator()()
+	{
+		Node *node = Cluster::findNode(node_id);
+		if (node == nullptr || node->leaving)
+			return;
+		jobSchedule(*this);
+		if (Options::membership != MEMBERSHIP_PARTIAL)
+			return;
+
+		// An empty active view is refilled from the passive one, the
+		// connect of a node without peers is never refused.
+		if (node->getPeersRaw().empty() && !node->passive_view.empty()) {
+			NodeId peer_id =
+				node->passive_view[Rnd::choose(node->passive_view)];
+			jobSchedule(JobConnect{node_id, peer_id});
+			return;
+		}
+
+		std::vector<NodeId> peers;
+		node->getEstablishedPeers(peers);
+		if (peers.empty())
+			return;
+		NodeId peer_id = peers[Rnd::choose(peers)];
+		auto payload = std::make_shared<std::vector<uint8_t>>();
+		node->prepageKnowledge();
+		getShuffleSample(node, *payload);
+		jobSchedule(JobShuffleSend{node_id, peer_id,
+					   std::move(payload), true});
+	}
+};
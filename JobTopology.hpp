@@ -5,13 +5,19 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 #include <Cluster.hpp>
 #include <Job.hpp>
+#include <Options.hpp>
+#include <PathTree.hpp>
+#include <ThreadPool.hpp>
 #include <Utils.hpp>
 
-struct Topology {
+// Metrics of the paths from a node and its connections.
+struct TopologyMetrics {
 	size_t known_count;
 	size_t conn_count;
 	size_t max_hops;
@@ -20,63 +26,20 @@ struct Topology {
 	size_t avg_latency;
 	size_t inaccessible_count;
 
-	NodeId extra_jump;
-	NodeId extra_drop;
-	std::vector<std::pair<NodeId, double>> tmp_jumps;
-
-	const Node& node;
-	const std::unordered_map<NodeId, KnownInfoNode>& known_nodes;
-
-	Topology(Node *node_) : node(*node_), known_nodes(node_->prepageKnowledge())
-	{
-		known_count = known_nodes.size();
-		conn_count = node.getConns().size();
-		calcHopsAndLatency();
-	}
-
 	size_t getOptimalConnCount() const
 	{
-		double base = known_count + INITIAL_CONNECT_COUNT;
-		size_t count = size_t(CONN_COEF * std::pow(base, .5) + .5);
-		if (count < INITIAL_CONNECT_COUNT)
-			count = INITIAL_CONNECT_COUNT;
-		if (count > known_count - 1)
-			count = known_count - 1;
-		return count;
+		return optimalConnCount(known_count);
 	}
 
-	std::vector<std::pair<NodeId, double>>& operator()(NodeId id)
+	void setPaths(const PathTree::Result& res)
 	{
-		tmp_jumps.clear();
-
-		auto itr = known_nodes.find(id);
-		if (itr == known_nodes.end())
-			return tmp_jumps;
-
-		const KnownInfoNode &info = itr->second;
-		bool need_extra_jump = id == node.getId() && extra_jump.isSet();
-		for (const auto& [peer_id, conn_info] : info.conns) {
-			if (id == node.getId() && peer_id == extra_drop)
-				continue;
-			if (need_extra_jump && peer_id == extra_jump)
-				need_extra_jump = false;
-			tmp_jumps.emplace_back(peer_id, conn_info.latency);
-		}
-		if (need_extra_jump) {
-			double lat = 2 * CROSS_DC_LATENCY;
-			tmp_jumps.emplace_back(extra_jump, lat);
-		}
-		return tmp_jumps;
-	}
-
-	void calcHopsAndLatency()
-	{
-		auto scan = scanGraph(node.getId(), known_nodes, *this);
-		max_hops = scan.max_hops;
-		avg_hops = scan.avg_hops;
-		max_latency = scan.max_latency;
-		avg_latency = scan.avg_latency;
-		inaccessible_count = scan.inaccessible_nodes.size();
+		max_hops = res.max_hops;
+		avg_hops = res.avg_hops;
+		max_latency = res.max_latency;
+		avg_latency = res.avg_latency;
+		// Partial knowledge is not expected to be connected.
+		inaccessible_count = Options::membership == MEMBERSHIP_PARTIAL ?
+				     0 : res.inaccessible_count;
 	}
 
 	double prosperity() const {
@@ -120,6 +83,262 @@ struct Topology {
 	}
 };
 
+// Paths from a node over its knowledge and what if it connects to or
+// disconnects from somebody.
+struct Topology : TopologyMetrics {
+	// Connect to or disconnect from a peer and the prosperity after that.
+	struct Move {
+		NodeId peer_id;
+		double prosp;
+	};
+
+	PathTree paths;
+
+	const Node& node;
+	const KnownInfoMap& known_nodes;
+	// Edges of the node in the paths: pairs of peer and latency.
+	std::vector<std::pair<NodeId, double>> row;
+
+	Topology(Node *node_) : node(*node_), known_nodes(node_->prepageKnowledge())
+	{
+		known_count = node.getAliveKnownCount();
+		conn_count = node.getConns().size();
+		const KnownInfoNode& info = *known_nodes.at(node.getId());
+		for (size_t i = 0; i < info.size(); i++)
+			row.emplace_back(info.peers[i], info.latencies[i]);
+		paths.build(node.getId(), known_nodes);
+		setPaths(paths.getBase());
+	}
+
+	// Topology @a t after @a moves, each connects to a peer of no edge
+	// or disconnects from one.
+	Topology(const Topology& t, const std::vector<NodeId>& moves)
+		: TopologyMetrics(t), node(t.node), known_nodes(t.known_nodes),
+		  row(t.row)
+	{
+		for (NodeId peer_id : moves) {
+			auto itr = std::find_if(row.begin(), row.end(),
+						[peer_id](const auto& e) {
+				return e.first == peer_id;
+			});
+			if (itr != row.end()) {
+				row.erase(itr);
+				conn_count--;
+			} else {
+				row.emplace_back(peer_id,
+						 getConnectLatency(peer_id));
+				conn_count++;
+			}
+		}
+		paths.build(node.getId(), known_nodes, row);
+		setPaths(paths.getBase());
+	}
+
+	bool hasPeer(NodeId id) const
+	{
+		return std::find_if(row.begin(), row.end(),
+				    [id](const auto& e) {
+			return e.first == id;
+		}) != row.end();
+	}
+
+	// Latency of a new connection to @a id.
+	double getConnectLatency(NodeId id) const
+	{
+		if (Options::latency_estimate == LATENCY_ESTIMATE_FLAT)
+			return 2 * CROSS_DC_LATENCY;
+		return node.getKnownLatency(id);
+	}
+
+	// Nodes to evaluate for connection in order of known_nodes.
+	void getConnectCandidates(std::vector<NodeId>& res) const
+	{
+		res.clear();
+		for (const auto& [anode_id, info] : known_nodes) {
+			if (hasPeer(anode_id) || node.isRejecting(anode_id))
+				continue;
+			if (anode_id == node.getId() || info->dead)
+				continue;
+			if (info->size() > getOptimalConnCount())
+				continue;
+			res.push_back(anode_id);
+		}
+	}
+
+	// Peers of the node in order of known_nodes.
+	void getDropCandidates(std::vector<NodeId>& res) const
+	{
+		res.clear();
+		for (const auto& [anode_id, info] : known_nodes)
+			if (hasPeer(anode_id))
+				res.push_back(anode_id);
+	}
+
+	// Append @a candidates to @a res with the prosperity @a eval gives
+	// with each. Candidates are evaluated in parallel.
+	template <class EVAL>
+	void evalMoves(const std::vector<NodeId>& candidates,
+		       std::vector<Move>& res, EVAL&& eval)
+	{
+		pool.resize(Options::topology_threads);
+		if (scratches.size() < pool.size())
+			scratches.resize(pool.size());
+		size_t first = res.size();
+		for (NodeId id : candidates)
+			res.push_back(Move{id, 0});
+		pool.parallelFor(candidates.size(), [&](size_t worker, size_t i) {
+			TopologyMetrics m = *this;
+			m.setPaths(eval(paths, scratches[worker], candidates[i]));
+			res[first + i].prosp = m.prosperity();
+		});
+	}
+
+	void evalConnects(const std::vector<NodeId>& candidates,
+			  std::vector<Move>& res)
+	{
+		conn_count++;
+		auto eval = [this](const PathTree& p, PathTree::Scratch& s,
+				   NodeId id) {
+			return p.evalAdd(s, id, getConnectLatency(id));
+		};
+		evalMoves(candidates, res, eval);
+		conn_count--;
+	}
+
+	void evalDrops(const std::vector<NodeId>& candidates,
+		       std::vector<Move>& res)
+	{
+		conn_count--;
+		auto eval = [](const PathTree& p, PathTree::Scratch& s,
+			       NodeId id) {
+			return p.evalDrop(s, id);
+		};
+		evalMoves(candidates, res, eval);
+		conn_count++;
+	}
+
+	// Evaluate connects to the candidates while the node has less than
+	// twice the optimal connections and drops while it has at least the
+	// optimal, in this order, no more than @a limit moves. Drops are kept
+	// first, connects over the limit are a random sample.
+	void evalMoves(std::vector<Move>& res, size_t limit = SIZE_MAX)
+	{
+		res.clear();
+		std::vector<NodeId> connects;
+		std::vector<NodeId> drops;
+		if (conn_count >= getOptimalConnCount()) {
+			getDropCandidates(drops);
+			if (drops.size() > limit)
+				drops.resize(limit);
+		}
+		if (conn_count < 2 * getOptimalConnCount()) {
+			getConnectCandidates(connects);
+			size_t count = limit - drops.size();
+			if (connects.size() > count) {
+				for (size_t i = 0; i < count; i++) {
+					size_t j = i + Rnd::getInt(
+						connects.size() - i);
+					std::swap(connects[i], connects[j]);
+				}
+				connects.resize(count);
+			}
+			evalConnects(connects, res);
+			TopologyCandidates::evaluated_count += connects.size();
+		}
+		evalDrops(drops, res);
+	}
+
+	// The first move that is better than @a cur_prosp and the others
+	// before it, cur_prosp is updated.
+	static NodeId findBest(const std::vector<Move>& moves,
+			       double& cur_prosp)
+	{
+		NodeId best;
+		for (const Move& m : moves) {
+			if (m.prosp > cur_prosp) {
+				best = m.peer_id;
+				cur_prosp = m.prosp;
+			}
+		}
+		return best;
+	}
+
+private:
+	// Shared by thinks of all nodes, one scratch per worker.
+	static inline ThreadPool pool;
+	static inline std::vector<PathTree::Scratch> scratches;
+};
+
+// Beam search of sequences of up to Options::topology_moves moves of @a t,
+// such as a swap of peers or a few connects at once. Sequences of each
+// length, starting with single @a moves, are cut to TOPOLOGY_BEAM_WIDTH
+// best ones and extended by the moves evaluated after them while
+// Options::topology_budget evaluations last, a rebuild of the paths for a
+// sequence costs TOPOLOGY_REBUILD_COST of them. A sequence that is better
+// than @a best_prosp replaces @a best and updates it.
+inline void
+searchMoves(const Topology& t, const std::vector<Topology::Move>& moves,
+	    std::vector<NodeId>& best, double& best_prosp)
+{
+	struct Sequence {
+		std::vector<NodeId> moves;
+		double prosp;
+	};
+	auto cmp = [](NodeId a, NodeId b) { return a.rawID() < b.rawID(); };
+	// The best sequences of different sets of moves.
+	auto cut = [&cmp](std::vector<Sequence>& seqs) {
+		std::stable_sort(seqs.begin(), seqs.end(),
+				 [](const Sequence& a, const Sequence& b) {
+			return a.prosp > b.prosp;
+		});
+		std::vector<std::vector<NodeId>> sets;
+		size_t count = 0;
+		for (Sequence& seq : seqs) {
+			if (count == TOPOLOGY_BEAM_WIDTH)
+				break;
+			std::vector<NodeId> set = seq.moves;
+			std::sort(set.begin(), set.end(), cmp);
+			if (std::find(sets.begin(), sets.end(), set) != sets.end())
+				continue;
+			sets.push_back(std::move(set));
+			seqs[count++] = std::move(seq);
+		}
+		seqs.resize(count);
+	};
+
+	std::vector<Sequence> beam;
+	for (const Topology::Move& m : moves)
+		beam.push_back(Sequence{{m.peer_id}, m.prosp});
+	std::vector<Sequence> next;
+	std::vector<Topology::Move> after;
+	size_t budget = Options::topology_budget;
+	for (size_t len = 1; len < Options::topology_moves; len++) {
+		cut(beam);
+		next.clear();
+		for (const Sequence& seq : beam) {
+			if (budget <= TOPOLOGY_REBUILD_COST)
+				break;
+			budget -= TOPOLOGY_REBUILD_COST;
+			Topology next_t(t, seq.moves);
+			next_t.evalMoves(after, budget);
+			budget -= after.size();
+			for (const Topology::Move& m : after) {
+				// Undoing a move gives a shorter sequence.
+				if (std::find(seq.moves.begin(), seq.moves.end(),
+					      m.peer_id) != seq.moves.end())
+					continue;
+				next.push_back(Sequence{seq.moves, m.prosp});
+				next.back().moves.push_back(m.peer_id);
+				if (m.prosp > best_prosp) {
+					best = next.back().moves;
+					best_prosp = m.prosp;
+				}
+			}
+		}
+		std::swap(beam, next);
+	}
+}
+
 struct JobTopology {
 	NodeId node_id;
 
@@ -132,65 +351,60 @@ struct JobTopology {
 	void operator()()
 	{
 		Node *node = Cluster::findNode(node_id);
-		if (node == nullptr)
+		if (node == nullptr || node->leaving)
 			return;
 		jobSchedule(*this);
 
-		Topology t(node);
-		if (Rnd::getDbl(1.) > t.urgency())
+		node->prepageKnowledge();
+		TopologyMemo& memo = node->topology_memo;
+		if (node->expireRejections())
+			memo = TopologyMemo{};
+		bool is_same = memo.knowledge_hash == node->knowledge_hash &&
+			       memo.conn_count == node->getConns().size() &&
+			       memo.options_version == Options::version;
+		if (is_same && memo.is_idle) {
+			TopologyCandidates::reused_count++;
+			return;
+		}
+		if (is_same && Rnd::getDbl(1.) > memo.urgency) {
+			TopologyCandidates::reused_count++;
 			return;
-
-		double cur_prosp = t.prosperity();
-		const KnownInfoNode &this_info = t.known_nodes.at(node_id);
-		NodeId best;
-
-		if (t.conn_count < 2 * t.getOptimalConnCount()) {
-			t.conn_count++;
-			for (const auto& [anode_id, info] : t.known_nodes) {
-				if (this_info.conns.count(anode_id) != 0)
-					continue;
-				if (anode_id == node_id)
-					continue;
-				if (info.conns.size() > t.getOptimalConnCount())
-					continue;
-				t.extra_jump = anode_id;
-				t.calcHopsAndLatency();
-				double prosp = t.prosperity();
-
-				if (prosp > cur_prosp) {
-					best = anode_id;
-					cur_prosp = prosp;
-				}
-			}
-			t.extra_jump.reset();
-			t.conn_count--;
 		}
 
-		if (t.conn_count >= t.getOptimalConnCount()) {
-			t.conn_count--;
-			for (const auto& [anode_id, info] : t.known_nodes) {
-				if (this_info.conns.count(anode_id) == 0)
-					continue;
-				t.extra_drop = anode_id;
-				t.calcHopsAndLatency();
-				double prosp = t.prosperity();
-				if (prosp > cur_prosp) {
-					best = anode_id;
-					cur_prosp = prosp;
-				}
-			}
-			t.extra_drop.reset();
-			t.conn_count++;
+		Topology t(node);
+		if (!is_same) {
+			memo = TopologyMemo{node->knowledge_hash, t.conn_count,
+					    Options::version, t.urgency(), false};
+			node->memoLatencies();
+			if (Rnd::getDbl(1.) > memo.urgency)
+				return;
 		}
 
-		if (!best.isSet())
+		double cur_prosp = t.prosperity();
+		std::vector<Topology::Move> moves;
+		t.evalMoves(moves);
+
+		std::vector<NodeId> best;
+		double best_prosp = cur_prosp;
+		NodeId first = Topology::findBest(moves, best_prosp);
+		if (first.isSet())
+			best.push_back(first);
+		if (Options::topology_moves > 1)
+			searchMoves(t, moves, best, best_prosp);
+
+		if (best.empty()) {
+			memo.is_idle = true;
 			return;
+		}
 
-		if (this_info.conns.count(best) == 0) {
-			jobSchedule(JobConnect{node_id, best});
-		} else {
-			for (ConnId conn_id : node->getPeerConns(best)) {
-				jobSchedule(JobDisconnect{node_id, conn_id});
+		TopologyCandidates::move_count += best.size();
+		for (NodeId peer_id : best) {
+			if (!t.hasPeer(peer_id)) {
+				jobSchedule(JobConnect{node_id, peer_id});
+			} else {
+				for (ConnId conn_id : node->getPeerConns(peer_id))
+					jobSchedule(JobDisconnect{node_id,
+								  conn_id});
 			}
 		}
 
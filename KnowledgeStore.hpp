@@ -0,0 +1,387 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Coordinates.hpp>
+#include <Options.hpp>
+#include <Scheduler.hpp>
+#include <Types.hpp>
+#include <Wire.hpp>
+
+// Connections of a node as they were published by the node itself under
+// some version. Each (origin, stamp) pair exists once in the cluster and
+// is shared by all nodes that know it.
+// A tombstone is a death certificate of origin issued by somebody else,
+// it has no peers and is newer than the alive info of the same version.
+struct KnownInfoNode {
+	NodeId origin;
+	size_t info_version;
+	bool dead;
+	size_t dc;
+	// Bit mask of DCs of origin's peers, with gossip_scope dc only.
+	size_t dc_links;
+	// Network coordinate of origin when it issued the info.
+	NetCoord coord;
+	// Not on the wire, for measurement of propagation: the time the info
+	// was issued, kept by KnowledgeStore if it is released and decoded
+	// from a message again.
+	size_t time_created;
+	// Number of nodes that have it in known_nodes and the number of
+	// CONVERGENCE_LEVELS their share has reached.
+	mutable size_t holder_count = 0;
+	mutable size_t converged_level = 0;
+	// Time when the tombstone was issued.
+	size_t dead_time;
+	// Sorted by id; latencies[i] is the latency of connection to peers[i].
+	std::vector<NodeId> peers;
+	std::vector<float> latencies;
+
+	// Order of infos of the same origin.
+	size_t stamp() const { return info_version * 2 + dead; }
+	size_t size() const { return peers.size(); }
+	bool hasPeer(NodeId peer_id) const;
+
+private:
+	friend class KnownInfoRef;
+	friend class KnowledgeStore;
+
+	size_t ref_count = 0;
+};
+
+// Counted reference to an interned KnownInfoNode, has the size of a pointer.
+class KnownInfoRef {
+public:
+	KnownInfoRef() noexcept = default;
+	~KnownInfoRef() noexcept;
+	KnownInfoRef(const KnownInfoRef& r) noexcept;
+	KnownInfoRef& operator=(const KnownInfoRef& r) noexcept;
+	KnownInfoRef(KnownInfoRef&& r) noexcept;
+	KnownInfoRef& operator=(KnownInfoRef&& r) noexcept;
+
+	const KnownInfoNode& operator*() const { return *info; }
+	const KnownInfoNode *operator->() const { return info; }
+	explicit operator bool() const { return info != nullptr; }
+
+private:
+	friend class KnowledgeStore;
+	explicit KnownInfoRef(KnownInfoNode *info_) noexcept;
+
+	KnownInfoNode *info = nullptr;
+};
+
+using KnownInfoMap = std::unordered_map<NodeId, KnownInfoRef>;
+
+// Wire format of knowledge: varint count of entries sorted by origin id.
+// Every entry is varint origin id delta, varint stamp and varint length
+// of the body. The body is varint dc, varint dc_links with gossip_scope dc,
+// the coordinate with latency_estimate coords, varint count of peers, delta
+// encoded peer ids and quantized latencies, or varint dead_time for a
+// tombstone.
+void encodeKnowledge(const KnownInfoMap& knowledge, std::vector<uint8_t>& buf);
+void encodeKnowledge(std::vector<const KnownInfoNode *>& infos,
+		     std::vector<uint8_t>& buf);
+
+// Decode @a buf and call @a apply for each entry that @a is_needed by
+// (origin, stamp). The bodies of other entries are skipped.
+// Return the number of entries.
+template <class IS_NEEDED, class APPLY>
+size_t decodeKnowledge(const std::vector<uint8_t>& buf,
+		     IS_NEEDED&& is_needed, APPLY&& apply);
+
+class KnowledgeStore {
+public:
+	// Get the info of @a origin of version @a info_version, create it
+	// from @a conns (pairs of peer id and latency) if there's no such.
+	static KnownInfoRef intern(NodeId origin, size_t info_version,
+				   size_t dc, size_t dc_links,
+				   const NetCoord& coord,
+				   std::vector<std::pair<NodeId, double>>& conns);
+	static KnownInfoRef internTombstone(NodeId origin, size_t info_version,
+					    size_t dead_time);
+	static KnownInfoRef find(NodeId origin, size_t stamp);
+	static size_t getInfoCount() { return instance().infos.size(); }
+
+	KnowledgeStore(const KnowledgeStore&) = delete;
+	KnowledgeStore& operator=(const KnowledgeStore&) = delete;
+private:
+	friend class KnownInfoRef;
+
+	KnowledgeStore() = default;
+	static KnowledgeStore& instance();
+	static void release(KnownInfoNode *info);
+	// Issue time of (@a origin, @a stamp), current time for a new stamp.
+	static size_t issueTime(NodeId origin, size_t stamp);
+
+	struct Key {
+		NodeId origin;
+		size_t stamp;
+		bool operator==(const Key& a) const
+		{
+			return origin == a.origin && stamp == a.stamp;
+		}
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& k) const noexcept
+		{
+			return k.origin.hash() * 0x9E3779B97F4A7C15ull ^
+			       k.stamp;
+		}
+	};
+
+	std::unordered_map<Key, std::unique_ptr<KnownInfoNode>, KeyHash> infos;
+	// Latest stamp of each origin and its issue time, until the tombstone
+	// of the origin is released.
+	std::unordered_map<NodeId, std::pair<size_t, size_t>> issued;
+};
+
+bool
+KnownInfoNode::hasPeer(NodeId peer_id) const
+{
+	auto cmp = [](NodeId a, NodeId b) { return a.rawID() < b.rawID(); };
+	return std::binary_search(peers.begin(), peers.end(), peer_id, cmp);
+}
+
+KnownInfoRef::KnownInfoRef(KnownInfoNode *info_) noexcept : info(info_)
+{
+	info->ref_count++;
+}
+
+KnownInfoRef::~KnownInfoRef() noexcept
+{
+	if (info != nullptr && --info->ref_count == 0)
+		KnowledgeStore::release(info);
+}
+
+KnownInfoRef::KnownInfoRef(const KnownInfoRef& r) noexcept : info(r.info)
+{
+	if (info != nullptr)
+		info->ref_count++;
+}
+
+KnownInfoRef&
+KnownInfoRef::operator=(const KnownInfoRef& r) noexcept
+{
+	KnownInfoRef tmp(r);
+	std::swap(info, tmp.info);
+	return *this;
+}
+
+KnownInfoRef::KnownInfoRef(KnownInfoRef&& r) noexcept : info(r.info)
+{
+	r.info = nullptr;
+}
+
+KnownInfoRef&
+KnownInfoRef::operator=(KnownInfoRef&& r) noexcept
+{
+	std::swap(info, r.info);
+	return *this;
+}
+
+KnowledgeStore&
+KnowledgeStore::instance()
+{
+	// Never destroyed: nodes and scheduled jobs may still hold references
+	// during destruction of other static objects.
+	static KnowledgeStore *inst = new KnowledgeStore;
+	return *inst;
+}
+
+KnownInfoRef
+KnowledgeStore::intern(NodeId origin, size_t info_version, size_t dc,
+		       size_t dc_links, const NetCoord& coord,
+		       std::vector<std::pair<NodeId, double>>& conns)
+{
+	KnowledgeStore& inst = instance();
+	auto& ptr = inst.infos[Key{origin, info_version * 2}];
+	if (ptr != nullptr)
+		return KnownInfoRef(ptr.get());
+
+	std::sort(conns.begin(), conns.end(), [](const auto& a, const auto& b) {
+		return a.first.rawID() < b.first.rawID();
+	});
+	ptr = std::make_unique<KnownInfoNode>();
+	ptr->origin = origin;
+	ptr->info_version = info_version;
+	ptr->dead = false;
+	ptr->dc = dc;
+	ptr->dc_links = dc_links;
+	ptr->coord = coord;
+	ptr->time_created = issueTime(origin, info_version * 2);
+	ptr->peers.reserve(conns.size());
+	ptr->latencies.reserve(conns.size());
+	for (const auto& [peer_id, latency] : conns) {
+		ptr->peers.push_back(peer_id);
+		ptr->latencies.push_back(latency);
+	}
+	return KnownInfoRef(ptr.get());
+}
+
+KnownInfoRef
+KnowledgeStore::internTombstone(NodeId origin, size_t info_version,
+				size_t dead_time)
+{
+	KnowledgeStore& inst = instance();
+	auto& ptr = inst.infos[Key{origin, info_version * 2 + 1}];
+	if (ptr == nullptr) {
+		ptr = std::make_unique<KnownInfoNode>();
+		ptr->origin = origin;
+		ptr->info_version = info_version;
+		ptr->dead = true;
+		ptr->dead_time = dead_time;
+		ptr->dc = SIZE_MAX;
+		ptr->dc_links = 0;
+		ptr->time_created = issueTime(origin, info_version * 2 + 1);
+	}
+	return KnownInfoRef(ptr.get());
+}
+
+KnownInfoRef
+KnowledgeStore::find(NodeId origin, size_t stamp)
+{
+	KnowledgeStore& inst = instance();
+	auto itr = inst.infos.find(Key{origin, stamp});
+	if (itr == inst.infos.end())
+		return KnownInfoRef{};
+	return KnownInfoRef(itr->second.get());
+}
+
+void
+KnowledgeStore::release(KnownInfoNode *info)
+{
+	KnowledgeStore& inst = instance();
+	assert(info->ref_count == 0);
+	if (info->dead) {
+		auto itr = inst.issued.find(info->origin);
+		if (itr != inst.issued.end() &&
+		    itr->second.first == info->stamp())
+			inst.issued.erase(itr);
+	}
+	inst.infos.erase(Key{info->origin, info->stamp()});
+}
+
+size_t
+KnowledgeStore::issueTime(NodeId origin, size_t stamp)
+{
+	KnowledgeStore& inst = instance();
+	auto [itr, inserted] = inst.issued.try_emplace(origin, stamp,
+						       Scheduler::now());
+	if (!inserted && itr->second.first < stamp)
+		itr->second = {stamp, Scheduler::now()};
+	// An older stamp has been superseded, its time isn't kept.
+	if (itr->second.first != stamp)
+		return Scheduler::now();
+	return itr->second.second;
+}
+
+void
+encodeKnowledge(const KnownInfoMap& knowledge, std::vector<uint8_t>& buf)
+{
+	std::vector<const KnownInfoNode *> infos;
+	infos.reserve(knowledge.size());
+	for (const auto& [node_id, info] : knowledge)
+		infos.push_back(&*info);
+	encodeKnowledge(infos, buf);
+}
+
+void
+encodeKnowledge(std::vector<const KnownInfoNode *>& infos,
+		std::vector<uint8_t>& buf)
+{
+	std::sort(infos.begin(), infos.end(), [](const auto *a, const auto *b) {
+		return a->origin.rawID() < b->origin.rawID();
+	});
+
+	WireWriter w(buf);
+	w.putVarint(infos.size());
+	size_t prev_origin = 0;
+	for (const KnownInfoNode *info : infos) {
+		w.putVarint(info->origin.rawID() - prev_origin);
+		prev_origin = info->origin.rawID();
+		w.putVarint(info->stamp());
+		size_t len_pos = w.startLength();
+		if (info->dead) {
+			w.putVarint(info->dead_time);
+			w.finishLength(len_pos);
+			continue;
+		}
+		w.putVarint(info->dc);
+		if (Options::gossip_scope == GOSSIP_SCOPE_DC)
+			w.putVarint(info->dc_links);
+		if (Options::latency_estimate == LATENCY_ESTIMATE_COORDS)
+			putCoord(w, info->coord);
+		w.putVarint(info->size());
+		size_t prev_peer = 0;
+		for (NodeId peer_id : info->peers) {
+			w.putVarint(peer_id.rawID() - prev_peer);
+			prev_peer = peer_id.rawID();
+		}
+		for (float latency : info->latencies)
+			w.putVarint(quantizeLatency(latency));
+		w.finishLength(len_pos);
+	}
+}
+
+template <class IS_NEEDED, class APPLY>
+size_t
+decodeKnowledge(const std::vector<uint8_t>& buf,
+		IS_NEEDED&& is_needed, APPLY&& apply)
+{
+	WireReader r(buf);
+	size_t count = r.getVarint();
+	size_t origin_raw = 0;
+	std::vector<std::pair<NodeId, double>> conns;
+	for (size_t i = 0; i < count; i++) {
+		origin_raw += r.getVarint();
+		NodeId origin = origin_raw;
+		size_t stamp = r.getVarint();
+		size_t len = r.getVarint();
+		if (!is_needed(origin, stamp)) {
+			r.skip(len);
+			continue;
+		}
+		KnownInfoRef info = KnowledgeStore::find(origin, stamp);
+		if (info) {
+			r.skip(len);
+			apply(std::move(info));
+			continue;
+		}
+		if (stamp % 2 != 0) {
+			size_t dead_time = r.getVarint();
+			apply(KnowledgeStore::internTombstone(origin, stamp / 2,
+							      dead_time));
+			continue;
+		}
+		size_t dc = r.getVarint();
+		size_t dc_links = 0;
+		if (Options::gossip_scope == GOSSIP_SCOPE_DC)
+			dc_links = r.getVarint();
+		NetCoord coord;
+		if (Options::latency_estimate == LATENCY_ESTIMATE_COORDS)
+			coord = getCoord(r);
+		size_t peer_count = r.getVarint();
+		conns.clear();
+		size_t peer_raw = 0;
+		for (size_t j = 0; j < peer_count; j++) {
+			peer_raw += r.getVarint();
+			conns.emplace_back(NodeId{peer_raw}, 0.);
+		}
+		for (size_t j = 0; j < peer_count; j++)
+			conns[j].second = dequantizeLatency(r.getVarint());
+		apply(KnowledgeStore::intern(origin, stamp / 2, dc, dc_links,
+					     coord, conns));
+	}
+	assert(!r.more());
+	return count;
+}
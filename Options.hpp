@@ -0,0 +1,205 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+#include <Constants.hpp>
+
+// Settings that can be changed for a run, see `set` command.
+
+enum GossipMode_t {
+	// Send all the known nodes to every peer.
+	GOSSIP_FULL,
+	// Send digest of known versions, exchange only the difference.
+	GOSSIP_DIGEST,
+	// Push updates along a spanning tree, announce them to other peers.
+	GOSSIP_PLUMTREE,
+};
+
+enum GossipScope_t {
+	// Gossip to all peers alike.
+	GOSSIP_SCOPE_FLAT,
+	// Gossip within DC, elected bridges send summaries to other DCs.
+	GOSSIP_SCOPE_DC,
+};
+
+enum GossipCadence_t {
+	// Gossip every GOSSIP_INTERVAL.
+	GOSSIP_CADENCE_FIXED,
+	// Gossip every GOSSIP_INTERVAL after a change, back off while none.
+	GOSSIP_CADENCE_ADAPTIVE,
+};
+
+enum HeartbeatCadence_t {
+	// Probe every connection every HEARTBEAT_INTERVAL.
+	HEARTBEAT_CADENCE_FIXED,
+	// Probe steady connections rarer, within the detection budget.
+	HEARTBEAT_CADENCE_ADAPTIVE,
+};
+
+enum PathMetric_t {
+	// Paths with the least hops, the least latency among them.
+	PATH_METRIC_HOPS,
+	// Paths with the least latency.
+	PATH_METRIC_LATENCY,
+};
+
+enum LatencyEstimate_t {
+	// Nodes that were never probed are far, across DCs.
+	LATENCY_ESTIMATE_FLAT,
+	// Predicted by network coordinates where they are accurate.
+	LATENCY_ESTIMATE_COORDS,
+};
+
+enum Membership_t {
+	// Every node learns the whole cluster graph.
+	MEMBERSHIP_FULL,
+	// Every node knows its neighborhood and a bounded passive view.
+	MEMBERSHIP_PARTIAL,
+};
+
+struct Options {
+	static inline GossipMode_t gossip_mode = GOSSIP_FULL;
+	static inline GossipScope_t gossip_scope = GOSSIP_SCOPE_FLAT;
+	static inline GossipCadence_t gossip_cadence = GOSSIP_CADENCE_FIXED;
+	static inline HeartbeatCadence_t heartbeat_cadence =
+		HEARTBEAT_CADENCE_FIXED;
+	static inline Membership_t membership = MEMBERSHIP_FULL;
+	// Paths that cluster status and topology thinks measure.
+	static inline PathMetric_t path_metric = PATH_METRIC_HOPS;
+	// Latency of connections that topology thinks consider.
+	static inline LatencyEstimate_t latency_estimate = LATENCY_ESTIMATE_FLAT;
+	// Number of nodes ClusterStatus scans from, 0 means all.
+	static inline size_t status_sample = 0;
+	// Change of latency to a peer that makes a node reissue its info,
+	// percent of the published latency.
+	static inline size_t latency_threshold = LATENCY_CHANGE_THRESHOLD;
+	// Adaptive heartbeat: time to detect a failure the probing interval
+	// may grow to and RTT deviation (percent of RTT) of a steady link.
+	static inline size_t detection_budget = DETECTION_BUDGET;
+	static inline size_t heartbeat_jitter = HEARTBEAT_JITTER;
+	// Threads that evaluate topology candidates, 1 is the simulation
+	// thread only.
+	static inline size_t topology_threads = 1;
+	// Most moves (connects and drops) a topology think makes together
+	// and the candidate evaluations it may spend on sequences of them,
+	// rebuilds of paths included.
+	static inline size_t topology_moves = 1;
+	static inline size_t topology_budget = TOPOLOGY_MOVE_BUDGET;
+	// Connections a node accepts up to, percent of its optimal count,
+	// 0 means all.
+	static inline size_t admission_degree = 0;
+	// Changes on every set, for results that depend on options.
+	static inline size_t version = 0;
+
+	// Plumtree works over the full membership only.
+	static bool usePlumtree()
+	{
+		return gossip_mode == GOSSIP_PLUMTREE &&
+		       membership == MEMBERSHIP_FULL;
+	}
+
+	// Set option @a name to @a value, return false if any is unknown.
+	static bool set(const std::string& name, const std::string& value);
+
+private:
+	static bool setNumber(const std::string& value, size_t& res);
+};
+
+bool
+Options::setNumber(const std::string& value, size_t& res)
+{
+	char *end;
+	unsigned long long num = strtoull(value.c_str(), &end, 10);
+	if (value.empty() || *end != 0)
+		return false;
+	res = num;
+	return true;
+}
+
+bool
+Options::set(const std::string& name, const std::string& value)
+{
+	version++;
+	if (name == "gossip_mode") {
+		if (value == "full")
+			gossip_mode = GOSSIP_FULL;
+		else if (value == "digest")
+			gossip_mode = GOSSIP_DIGEST;
+		else if (value == "plumtree")
+			gossip_mode = GOSSIP_PLUMTREE;
+		else
+			return false;
+		return true;
+	} else if (name == "gossip_scope") {
+		if (value == "flat")
+			gossip_scope = GOSSIP_SCOPE_FLAT;
+		else if (value == "dc")
+			gossip_scope = GOSSIP_SCOPE_DC;
+		else
+			return false;
+		return true;
+	} else if (name == "gossip_cadence") {
+		if (value == "fixed")
+			gossip_cadence = GOSSIP_CADENCE_FIXED;
+		else if (value == "adaptive")
+			gossip_cadence = GOSSIP_CADENCE_ADAPTIVE;
+		else
+			return false;
+		return true;
+	} else if (name == "heartbeat_cadence") {
+		if (value == "fixed")
+			heartbeat_cadence = HEARTBEAT_CADENCE_FIXED;
+		else if (value == "adaptive")
+			heartbeat_cadence = HEARTBEAT_CADENCE_ADAPTIVE;
+		else
+			return false;
+		return true;
+	} else if (name == "membership") {
+		if (value == "full")
+			membership = MEMBERSHIP_FULL;
+		else if (value == "partial")
+			membership = MEMBERSHIP_PARTIAL;
+		else
+			return false;
+		return true;
+	} else if (name == "path_metric") {
+		if (value == "hops")
+			path_metric = PATH_METRIC_HOPS;
+		else if (value == "latency")
+			path_metric = PATH_METRIC_LATENCY;
+		else
+			return false;
+		return true;
+	} else if (name == "latency_estimate") {
+		if (value == "flat")
+			latency_estimate = LATENCY_ESTIMATE_FLAT;
+		else if (value == "coords")
+			latency_estimate = LATENCY_ESTIMATE_COORDS;
+		else
+			return false;
+		return true;
+	} else if (name == "status_sample") {
+		return setNumber(value, status_sample);
+	} else if (name == "latency_threshold") {
+		return setNumber(value, latency_threshold);
+	} else if (name == "detection_budget") {
+		return setNumber(value, detection_budget);
+	} else if (name == "heartbeat_jitter") {
+		return setNumber(value, heartbeat_jitter);
+	} else if (name == "topology_threads") {
+		return setNumber(value, topology_threads);
+	} else if (name == "topology_moves") {
+		return setNumber(value, topology_moves);
+	} else if (name == "topology_budget") {
+		return setNumber(value, topology_budget);
+	} else if (name == "admission_degree") {
+		return setNumber(value, admission_degree);
+	}
+	return false;
+}
@@ -0,0 +1,466 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <vector>
+
+#include <Graph.hpp>
+#include <KnowledgeStore.hpp>
+#include <Options.hpp>
+#include <Utils.hpp>
+
+// Paths from a node over the known graph as Graph finds them by the path
+// metric of the run. Evaluates what if the
+// origin adds or drops one of its edges by relaxing only the nodes whose
+// paths change, instead of a rescan. Evaluations only read the tree and
+// may run in parallel, each with its own Scratch. Debug builds check every
+// evaluation against a rescan of the changed graph.
+class PathTree {
+	static constexpr uint32_t NO_HOPS = Graph::NO_HOPS;
+
+	using Edge = Graph::Edge;
+
+	struct Label {
+		uint32_t hops;
+		double latency;
+		bool operator==(const Label& a) const
+		{
+			return hops == a.hops && latency == a.latency;
+		}
+	};
+
+	// Label in the order of the metric, the least is on top.
+	struct HeapItem {
+		std::pair<double, double> key;
+		Label label;
+		uint32_t v;
+		bool operator<(const HeapItem& a) const
+		{
+			return a.key < key;
+		}
+	};
+
+public:
+	// Same as the metrics of Graph::scan, inaccessible are alive known
+	// nodes.
+	struct Result {
+		size_t max_hops;
+		double avg_hops;
+		double max_latency;
+		double avg_latency;
+		size_t inaccessible_count;
+	};
+
+	// State of an evaluation: vertices with stamp == epoch have new
+	// labels.
+	class Scratch {
+		friend class PathTree;
+		uint32_t epoch = 0;
+		std::vector<uint32_t> stamp;
+		std::vector<Label> new_labels;
+		std::vector<uint32_t> changed;
+		std::vector<long> hop_delta;
+		std::priority_queue<HeapItem> heap;
+		std::vector<uint32_t> affected;
+	};
+
+	// Build the graph of @a known and the paths from @a origin, the edges
+	// of the origin are the ones of its info or @a origin_row.
+	void build(NodeId origin, const KnownInfoMap& known);
+	void build(NodeId origin, const KnownInfoMap& known,
+		   const std::vector<std::pair<NodeId, double>>& origin_row);
+	const Result& getBase() const { return base; }
+	// Paths if the origin had an edge to @a peer_id of @a latency.
+	Result evalAdd(NodeId peer_id, double latency)
+	{
+		return evalAdd(scratch, peer_id, latency);
+	}
+	Result evalAdd(Scratch& s, NodeId peer_id, double latency) const;
+	// Paths if the origin had no edge to @a peer_id.
+	Result evalDrop(NodeId peer_id) { return evalDrop(scratch, peer_id); }
+	Result evalDrop(Scratch& s, NodeId peer_id) const;
+
+private:
+	// Unreached is worse than any path by either metric.
+	static Label unreached()
+	{
+		return Label{NO_HOPS, std::numeric_limits<double>::infinity()};
+	}
+	bool less(const Label& a, const Label& b) const
+	{
+		if (metric == PATH_METRIC_HOPS)
+			return a.hops < b.hops ||
+			       (a.hops == b.hops && a.latency < b.latency);
+		return a.latency < b.latency ||
+		       (a.latency == b.latency && a.hops < b.hops);
+	}
+	HeapItem heapItem(const Label& label, uint32_t v) const
+	{
+		if (metric == PATH_METRIC_HOPS)
+			return HeapItem{{label.hops, label.latency}, label, v};
+		return HeapItem{{label.latency, label.hops}, label, v};
+	}
+	Label next(uint32_t v, double latency) const
+	{
+		return Label{labels[v].hops + 1, labels[v].latency + latency};
+	}
+	const Label& cur(const Scratch& s, uint32_t v) const
+	{
+		return s.stamp[v] == s.epoch ? s.new_labels[v] : labels[v];
+	}
+	void buildPaths();
+	Result relaxAdd(Scratch& s, NodeId peer_id, uint32_t latency) const;
+	Result relaxDrop(Scratch& s, NodeId peer_id) const;
+	// Assert that @a res is what Graph finds if the origin had an edge
+	// to @a peer_id of @a latency, or had none if @a latency is 0.
+	void check(const Result& res, NodeId peer_id, uint32_t latency) const;
+	void begin(Scratch& s) const;
+	void setNew(Scratch& s, uint32_t v, const Label& label) const;
+	void relax(Scratch& s) const;
+	Result finish(Scratch& s) const;
+
+	PathMetric_t metric;
+	// Vertices: known nodes and their peers, the origin is 0, and the
+	// reverse edges in compressed rows.
+	Graph graph;
+	std::vector<uint32_t> in_begin;
+	std::vector<Edge> in_edges;
+	// Workspace of the full scan, reused by rebuilds.
+	Graph::Paths paths;
+	std::vector<Label> labels;
+	// Number of vertices by hops and reached vertices by latency desc.
+	std::vector<size_t> hop_count;
+	std::vector<uint32_t> by_latency;
+	Result base;
+	size_t sum_hops;
+	double sum_latency;
+	size_t reached_count;
+	Scratch scratch;
+};
+
+void
+PathTree::build(NodeId origin, const KnownInfoMap& known)
+{
+	graph.build(origin, known);
+	buildPaths();
+}
+
+void
+PathTree::build(NodeId origin, const KnownInfoMap& known,
+		const std::vector<std::pair<NodeId, double>>& origin_row)
+{
+	graph.build(origin, known, origin_row);
+	buildPaths();
+}
+
+void
+PathTree::buildPaths()
+{
+	metric = Options::path_metric;
+	size_t n = graph.size();
+	in_begin.assign(n + 1, 0);
+	for (uint32_t v = 0; v < n; v++)
+		for (const Edge *e = graph.begin(v); e != graph.end(v); e++)
+			in_begin[e->to + 1]++;
+	for (size_t v = 0; v < n; v++)
+		in_begin[v + 1] += in_begin[v];
+	std::vector<uint32_t> in_pos(in_begin.begin(), in_begin.end() - 1);
+	in_edges.resize(in_begin[n]);
+	for (uint32_t v = 0; v < n; v++)
+		for (const Edge *e = graph.begin(v); e != graph.end(v); e++)
+			in_edges[in_pos[e->to]++] = Edge{v, e->latency};
+
+	Graph::Scan scan = graph.findPaths(0, metric, paths);
+	labels.assign(n, unreached());
+	hop_count.clear();
+	by_latency.clear();
+	sum_hops = 0;
+	sum_latency = 0;
+	for (uint32_t v = 0; v < n; v++) {
+		uint32_t hops = paths.getHops(v);
+		if (hops == NO_HOPS)
+			continue;
+		labels[v] = Label{hops, double(paths.getLatency(v))};
+		if (hop_count.size() <= hops)
+			hop_count.resize(hops + 1, 0);
+		hop_count[hops]++;
+		if (v == 0)
+			continue;
+		sum_hops += hops;
+		sum_latency += labels[v].latency;
+		by_latency.push_back(v);
+	}
+	std::sort(by_latency.begin(), by_latency.end(),
+		  [this](uint32_t a, uint32_t b) {
+		return labels[b].latency < labels[a].latency;
+	});
+	reached_count = scan.reached_count;
+
+	base.max_hops = scan.max_hops;
+	base.avg_hops = scan.avg_hops;
+	base.max_latency = scan.max_latency;
+	base.avg_latency = scan.avg_latency;
+	base.inaccessible_count = scan.inaccessible_count;
+}
+
+void
+PathTree::begin(Scratch& s) const
+{
+	// Stamps of previous trees are older than the epoch, the deltas are
+	// zeroed by every evaluation.
+	size_t n = labels.size();
+	if (s.stamp.size() < n) {
+		s.stamp.resize(n, 0);
+		s.new_labels.resize(n);
+		s.hop_delta.resize(n + 1, 0);
+	}
+	if (++s.epoch == 0) {
+		std::fill(s.stamp.begin(), s.stamp.end(), 0);
+		s.epoch = 1;
+	}
+	s.changed.clear();
+}
+
+void
+PathTree::setNew(Scratch& s, uint32_t v, const Label& label) const
+{
+	if (s.stamp[v] != s.epoch) {
+		s.stamp[v] = s.epoch;
+		s.changed.push_back(v);
+	}
+	s.new_labels[v] = label;
+}
+
+void
+PathTree::relax(Scratch& s) const
+{
+	while (!s.heap.empty()) {
+		HeapItem item = s.heap.top();
+		s.heap.pop();
+		uint32_t v = item.v;
+		if (!(item.label == s.new_labels[v]))
+			continue;
+		for (const Edge *e = graph.begin(v); e != graph.end(v); e++) {
+			if (e->to == 0)
+				continue;
+			Label label{item.label.hops + 1,
+				    item.label.latency + e->latency};
+			if (!less(label, cur(s, e->to)))
+				continue;
+			setNew(s, e->to, label);
+			s.heap.push(heapItem(label, e->to));
+		}
+	}
+}
+
+PathTree::Result
+PathTree::evalAdd(Scratch& s, NodeId peer_id, double latency) const
+{
+	Result res = relaxAdd(s, peer_id, Graph::toLatency(latency));
+#ifndef NDEBUG
+	check(res, peer_id, Graph::toLatency(latency));
+#endif
+	return res;
+}
+
+PathTree::Result
+PathTree::evalDrop(Scratch& s, NodeId peer_id) const
+{
+	Result res = relaxDrop(s, peer_id);
+#ifndef NDEBUG
+	check(res, peer_id, 0);
+#endif
+	return res;
+}
+
+PathTree::Result
+PathTree::relaxAdd(Scratch& s, NodeId peer_id, uint32_t latency) const
+{
+	begin(s);
+	uint32_t v = graph.find(peer_id);
+	if (v != Graph::NO_VERTEX && v != 0) {
+		Label label{1, double(latency)};
+		if (less(label, labels[v])) {
+			setNew(s, v, label);
+			s.heap.push(heapItem(label, v));
+			relax(s);
+		}
+	}
+	return finish(s);
+}
+
+PathTree::Result
+PathTree::relaxDrop(Scratch& s, NodeId peer_id) const
+{
+	begin(s);
+	uint32_t y = graph.find(peer_id);
+	if (y == Graph::NO_VERTEX)
+		return base;
+	const Edge *dropped = nullptr;
+	for (const Edge *e = graph.begin(0); e != graph.end(0); e++)
+		if (e->to == y)
+			dropped = e;
+	if (dropped == nullptr || !(next(0, dropped->latency) == labels[y]))
+		return base;
+
+	// Affected are vertices all of whose tight incoming edges come from
+	// affected ones, they are found wave by wave and marked by NO_HOPS.
+	std::vector<uint32_t>& affected = s.affected;
+	affected.clear();
+	affected.push_back(y);
+	setNew(s, y, unreached());
+	for (size_t k = 0; k < affected.size(); k++) {
+		uint32_t v = affected[k];
+		for (const Edge *e = graph.begin(v); e != graph.end(v); e++) {
+			uint32_t z = e->to;
+			if (s.stamp[z] == s.epoch ||
+			    !(next(v, e->latency) == labels[z]))
+				continue;
+			bool has_other_parent = false;
+			for (uint32_t j = in_begin[z]; j < in_begin[z + 1]; j++) {
+				const Edge& e = in_edges[j];
+				if (s.stamp[e.to] != s.epoch &&
+				    labels[e.to].hops != NO_HOPS &&
+				    next(e.to, e.latency) == labels[z]) {
+					has_other_parent = true;
+					break;
+				}
+			}
+			if (has_other_parent)
+				continue;
+			affected.push_back(z);
+			setNew(s, z, unreached());
+		}
+	}
+
+	// The best paths through unaffected vertices, then relax among
+	// affected ones.
+	for (uint32_t v : affected) {
+		Label best = unreached();
+		for (uint32_t j = in_begin[v]; j < in_begin[v + 1]; j++) {
+			const Edge& e = in_edges[j];
+			if (s.stamp[e.to] == s.epoch ||
+			    labels[e.to].hops == NO_HOPS)
+				continue;
+			if (e.to == 0 && v == y)
+				continue;
+			Label label = next(e.to, e.latency);
+			if (less(label, best))
+				best = label;
+		}
+		if (best.hops == NO_HOPS)
+			continue;
+		s.new_labels[v] = best;
+		s.heap.push(heapItem(best, v));
+	}
+	relax(s);
+	return finish(s);
+}
+
+PathTree::Result
+PathTree::finish(Scratch& s) const
+{
+	const std::vector<uint32_t>& changed = s.changed;
+	const std::vector<Label>& new_labels = s.new_labels;
+	std::vector<long>& hop_delta = s.hop_delta;
+	if (changed.empty())
+		return base;
+
+	Result res = base;
+	long hops_diff = 0;
+	double latency_diff = 0;
+	long reached_diff = 0;
+	long inaccessible_diff = 0;
+	size_t max_hops = 0;
+	double max_latency = 0;
+	for (uint32_t v : changed) {
+		const Label& from = labels[v];
+		const Label& to = new_labels[v];
+		if (from.hops != NO_HOPS) {
+			hops_diff -= from.hops;
+			latency_diff -= from.latency;
+			hop_delta[from.hops]--;
+			reached_diff--;
+			inaccessible_diff += graph.isAlive(v);
+		}
+		if (to.hops != NO_HOPS) {
+			hops_diff += to.hops;
+			latency_diff += to.latency;
+			hop_delta[to.hops]++;
+			reached_diff++;
+			inaccessible_diff -= graph.isAlive(v);
+			updMax(max_hops, to.hops);
+			updMax(max_latency, to.latency);
+		}
+	}
+
+	for (size_t h = hop_count.size() - 1; h > max_hops; h--) {
+		if (long(hop_count[h]) + hop_delta[h] > 0) {
+			max_hops = h;
+			break;
+		}
+	}
+	for (uint32_t v : changed) {
+		if (labels[v].hops != NO_HOPS)
+			hop_delta[labels[v].hops] = 0;
+		if (new_labels[v].hops != NO_HOPS)
+			hop_delta[new_labels[v].hops] = 0;
+	}
+	for (uint32_t v : by_latency) {
+		if (s.stamp[v] == s.epoch)
+			continue;
+		updMax(max_latency, labels[v].latency);
+		break;
+	}
+
+	size_t reached = reached_count + reached_diff;
+	res.max_hops = max_hops;
+	res.avg_hops = double(sum_hops + hops_diff) / (reached + 1);
+	res.max_latency = max_latency;
+	res.avg_latency = (sum_latency + latency_diff) / (reached + 1);
+	res.inaccessible_count = base.inaccessible_count + inaccessible_diff;
+	return res;
+}
+
+void
+PathTree::check([[maybe_unused]] const Result& res, NodeId peer_id,
+		uint32_t latency) const
+{
+	// Evaluations ignore peers that are not in the graph.
+	uint32_t y = graph.find(peer_id);
+	if (y == Graph::NO_VERTEX || y == 0)
+		return;
+	std::vector<NodeId> vids;
+	for (uint32_t v = 0; v < graph.size(); v++)
+		vids.push_back(graph.getId(v));
+	Graph changed;
+	changed.build(vids, [&](NodeId id, auto& row) {
+		uint32_t v = graph.find(id);
+		for (const Edge *e = graph.begin(v); e != graph.end(v); e++)
+			if (v != 0 || e->to != y || latency != 0)
+				row.emplace_back(graph.getId(e->to), e->latency);
+		if (v == 0 && latency != 0)
+			row.emplace_back(peer_id, latency);
+		return graph.isAlive(v);
+	});
+	Graph::Paths scan_paths;
+	[[maybe_unused]] Graph::Scan scan =
+		changed.findPaths(0, metric, scan_paths);
+	[[maybe_unused]] auto near = [](double a, double b) {
+		return std::fabs(a - b) <= 1e-9 * std::max(1., std::fabs(b));
+	};
+	assert(res.max_hops == scan.max_hops);
+	assert(res.inaccessible_count == scan.inaccessible_count);
+	assert(near(res.max_latency, scan.max_latency));
+	assert(near(res.avg_hops, scan.avg_hops));
+	assert(near(res.avg_latency, scan.avg_latency));
+}
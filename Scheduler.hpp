@@ -16,6 +16,8 @@ public:
 	static void next();
 	static bool more();
 	static size_t now();
+	// Number of tasks executed.
+	static size_t getEventCount();
 
 	Scheduler(const Scheduler&) = delete;
 	Scheduler& operator=(const Scheduler&) = delete;
@@ -25,9 +27,11 @@ private:
 
 	struct Task {
 		template <class F>
-		Task(size_t time, F&& f);
+		Task(size_t time, size_t seq, F&& f);
 
 		size_t time;
+		// Tasks of the same time run in order of addition.
+		size_t seq;
 		std::function<void()> func;
 	};
 
@@ -41,20 +45,23 @@ private:
 	};
 
 	size_t cur_time;
+	size_t event_count = 0;
+	size_t task_count = 0;
 	std::set<std::unique_ptr<Task>, TaskCmp> tasks;
 };
 
 template <class F>
-Scheduler::Task::Task(size_t t, F&& f)
+Scheduler::Task::Task(size_t t, size_t s, F&& f)
 {
 	time = t;
+	seq = s;
 	func = std::forward<F>(f);
 }
 
 bool
 Scheduler::TaskCmp::operator()(const Task *a, const Task *b) const
 {
-	return std::tie(a->time, a) < std::tie(b->time, b);
+	return std::tie(a->time, a->seq) < std::tie(b->time, b->seq);
 }
 
 Scheduler&
@@ -70,7 +77,8 @@ Scheduler::add(size_t wait, F&& f)
 {
 	Scheduler &inst = instance();
 	size_t time = inst.cur_time + wait;
-	auto t = std::make_unique<Task>(time, std::forward<F>(f));
+	auto t = std::make_unique<Task>(time, inst.task_count++,
+					std::forward<F>(f));
 	inst.tasks.insert(std::move(t));
 }
 
@@ -81,6 +89,7 @@ Scheduler::next()
 	auto handle = inst.tasks.extract(inst.tasks.begin());
 	std::unique_ptr<Task>& task = handle.value();
 	inst.cur_time = task->time;
+	inst.event_count++;
 	task->func();
 }
 
@@ -97,3 +106,10 @@ Scheduler::now()
 	Scheduler &inst = instance();
 	return inst.cur_time;
 }
+
+size_t
+Scheduler::getEventCount()
+{
+	Scheduler &inst = instance();
+	return inst.event_count;
+}
@@ -5,16 +5,28 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 
 constexpr double EXP_AVG_ALPHA = 0.05;
+constexpr size_t ARRIVAL_WINDOW_SIZE = 100;
 
+// Exponentially weighted moving average and variance.
 class ExpAvg {
 public:
 	void update(double val)
 	{
-		avg = EXP_AVG_ALPHA * val +
-		      (1. - EXP_AVG_ALPHA) * (is_set ? avg : val);
+		if (!is_set) {
+			is_set = true;
+			avg = val;
+			return;
+		}
+		double diff = val - avg;
+		double incr = EXP_AVG_ALPHA * diff;
+		avg += incr;
+		var = (1. - EXP_AVG_ALPHA) * (var + diff * incr);
 	}
 
 	double get() const
@@ -22,6 +34,16 @@ public:
 		return avg;
 	}
 
+	double getVariance() const
+	{
+		return var;
+	}
+
+	double getDeviation() const
+	{
+		return std::sqrt(var);
+	}
+
 	bool is() const
 	{
 		return is_set;
@@ -30,4 +52,343 @@ public:
 private:
 	bool is_set = false;
 	double avg = 0;
+	double var = 0;
+};
+
+// Streaming estimation of quantile @a p by P-square algorithm: five
+// markers whose heights are adjusted by piecewise-parabolic prediction.
+class P2Quantile {
+public:
+	explicit P2Quantile(double p_) : p(p_) {}
+
+	void update(double val);
+	double get() const;
+
+	size_t getCount() const
+	{
+		return count;
+	}
+
+private:
+	double parabolic(size_t i, double d) const;
+	double linear(size_t i, double d) const;
+
+	double p;
+	size_t count = 0;
+	// Heights and positions of markers and desired positions.
+	double q[5];
+	double n[5];
+	double np[5];
+};
+
+// Minimum over a sliding time window, kept by the best three samples of
+// subsequent parts of the window (Kathleen Nichols' algorithm).
+class WindowedMin {
+public:
+	explicit WindowedMin(size_t window_) : window(window_) {}
+
+	void update(size_t now, double val);
+
+	double get() const
+	{
+		return s[0].val;
+	}
+
+	bool is() const
+	{
+		return is_set;
+	}
+
+private:
+	struct Sample {
+		size_t time;
+		double val;
+	};
+
+	size_t window;
+	bool is_set = false;
+	Sample s[3];
+};
+
+// Histogram of non-negative values with buckets of 1 / 2^SUB_BITS of
+// the power of two they belong to, values above 2^32 are clamped.
+class LogHistogram {
+public:
+	static constexpr size_t SUB_BITS = 3;
+	static constexpr size_t SUB_COUNT = size_t(1) << SUB_BITS;
+	static constexpr size_t BUCKET_COUNT = (32 - SUB_BITS + 1) * SUB_COUNT;
+
+	void update(double val)
+	{
+		buckets[bucket(val)]++;
+		count++;
+	}
+
+	size_t getCount() const
+	{
+		return count;
+	}
+
+	// Middle of the bucket that holds quantile @a p.
+	double getQuantile(double p) const;
+
+	void clear()
+	{
+		*this = LogHistogram{};
+	}
+
+private:
+	static size_t bucket(double val);
+	static double bucketMiddle(size_t idx);
+
+	size_t count = 0;
+	uint32_t buckets[BUCKET_COUNT] = {};
+};
+
+// Intervals between arrivals of heartbeats over a sliding window and the
+// phi-accrual level of suspicion that the next one is not coming.
+class ArrivalWindow {
+public:
+	// First arrival, until there are intervals assume ones around
+	// @a expected_interval.
+	void start(size_t now, double expected_interval)
+	{
+		is_set = true;
+		add(expected_interval * .75);
+		add(expected_interval * 1.25);
+		last = now;
+	}
+
+	void update(size_t now)
+	{
+		add(now - last);
+		last = now;
+	}
+
+	bool is() const
+	{
+		return is_set;
+	}
+
+	// -log10 of probability that a heartbeat comes after @a now, by
+	// normal distribution (logistic approximation) of the intervals,
+	// with mean and deviation not less than @a min_mean and @a min_stddev.
+	double phi(size_t now, double min_mean, double min_stddev) const
+	{
+		if (!is_set)
+			return 0;
+		double mean = std::max(sum / count, min_mean);
+		double var = std::max(sum_sq / count - mean * mean, 0.);
+		double stddev = std::max(std::sqrt(var), min_stddev);
+		double elapsed = now - last;
+		double y = (elapsed - mean) / stddev;
+		double e = std::exp(-y * (1.5976 + 0.070566 * y * y));
+		if (elapsed > mean)
+			return -std::log10(e / (1. + e));
+		return -std::log10(1. - 1. / (1. + e));
+	}
+
+private:
+	void add(double interval)
+	{
+		if (count == ARRIVAL_WINDOW_SIZE) {
+			sum -= intervals[pos];
+			sum_sq -= intervals[pos] * intervals[pos];
+		} else {
+			count++;
+		}
+		intervals[pos] = interval;
+		sum += interval;
+		sum_sq += interval * interval;
+		pos = (pos + 1) % ARRIVAL_WINDOW_SIZE;
+	}
+
+	bool is_set = false;
+	size_t last = 0;
+	float intervals[ARRIVAL_WINDOW_SIZE];
+	size_t pos = 0;
+	size_t count = 0;
+	double sum = 0;
+	double sum_sq = 0;
 };
+
+// Count, average and maximum of a series.
+class SumMax {
+public:
+	void update(double val)
+	{
+		sum += val;
+		count++;
+		if (max < val)
+			max = val;
+	}
+
+	size_t getCount() const
+	{
+		return count;
+	}
+
+	double getAvg() const
+	{
+		return count == 0 ? 0 : sum / count;
+	}
+
+	double getMax() const
+	{
+		return max;
+	}
+
+private:
+	double sum = 0;
+	size_t count = 0;
+	double max = 0;
+};
+
+void
+P2Quantile::update(double val)
+{
+	if (count < 5) {
+		q[count++] = val;
+		if (count < 5)
+			return;
+		std::sort(q, q + 5);
+		for (size_t i = 0; i < 5; i++)
+			n[i] = i;
+		np[0] = 0;
+		np[1] = 2 * p;
+		np[2] = 4 * p;
+		np[3] = 2 + 2 * p;
+		np[4] = 4;
+		return;
+	}
+	count++;
+
+	size_t k;
+	if (val < q[0]) {
+		q[0] = val;
+		k = 0;
+	} else if (val >= q[4]) {
+		q[4] = val;
+		k = 3;
+	} else {
+		k = 0;
+		while (val >= q[k + 1])
+			k++;
+	}
+	for (size_t i = k + 1; i < 5; i++)
+		n[i]++;
+	const double dn[5] = {0, p / 2, p, (1 + p) / 2, 1};
+	for (size_t i = 0; i < 5; i++)
+		np[i] += dn[i];
+
+	for (size_t i = 1; i < 4; i++) {
+		double d = np[i] - n[i];
+		if ((d >= 1 && n[i + 1] - n[i] > 1) ||
+		    (d <= -1 && n[i - 1] - n[i] < -1)) {
+			d = d > 0 ? 1 : -1;
+			double h = parabolic(i, d);
+			if (q[i - 1] < h && h < q[i + 1])
+				q[i] = h;
+			else
+				q[i] = linear(i, d);
+			n[i] += d;
+		}
+	}
+}
+
+double
+P2Quantile::parabolic(size_t i, double d) const
+{
+	return q[i] + d / (n[i + 1] - n[i - 1]) *
+	       ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+		(n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+double
+P2Quantile::linear(size_t i, double d) const
+{
+	size_t j = d > 0 ? i + 1 : i - 1;
+	return q[i] + d * (q[j] - q[i]) / (n[j] - n[i]);
+}
+
+double
+P2Quantile::get() const
+{
+	if (count >= 5)
+		return q[2];
+	if (count == 0)
+		return 0;
+	double sorted[5];
+	std::copy(q, q + count, sorted);
+	std::sort(sorted, sorted + count);
+	return sorted[std::min(count - 1, size_t(p * count))];
+}
+
+void
+WindowedMin::update(size_t now, double val)
+{
+	Sample sample{now, val};
+	if (!is_set || val <= s[0].val || now - s[2].time > window) {
+		is_set = true;
+		s[0] = s[1] = s[2] = sample;
+		return;
+	}
+	if (val <= s[1].val)
+		s[1] = s[2] = sample;
+	else if (val <= s[2].val)
+		s[2] = sample;
+
+	// Pass the best samples of expired parts of the window on.
+	size_t dt = now - s[0].time;
+	if (dt > window) {
+		s[0] = s[1];
+		s[1] = s[2];
+		s[2] = sample;
+		if (now - s[0].time > window) {
+			s[0] = s[1];
+			s[1] = s[2];
+		}
+	} else if (s[1].time == s[0].time && dt > window / 4) {
+		s[1] = s[2] = sample;
+	} else if (s[2].time == s[1].time && dt > window / 2) {
+		s[2] = sample;
+	}
+}
+
+size_t
+LogHistogram::bucket(double val)
+{
+	uint64_t v = val < 0 ? 0 : uint64_t(val);
+	if (v < SUB_COUNT)
+		return v;
+	size_t e = 63 - __builtin_clzll(v);
+	size_t res = (e - SUB_BITS + 1) * SUB_COUNT +
+		     (v >> (e - SUB_BITS)) - SUB_COUNT;
+	return std::min(res, BUCKET_COUNT - 1);
+}
+
+double
+LogHistogram::bucketMiddle(size_t idx)
+{
+	if (idx < SUB_COUNT)
+		return idx;
+	size_t e = idx / SUB_COUNT + SUB_BITS - 1;
+	size_t sub = idx % SUB_COUNT;
+	double width = double(uint64_t(1) << (e - SUB_BITS));
+	return (SUB_COUNT + sub) * width + width / 2;
+}
+
+double
+LogHistogram::getQuantile(double p) const
+{
+	if (count == 0)
+		return 0;
+	size_t rank = std::min(count - 1, size_t(p * count));
+	size_t seen = 0;
+	for (size_t i = 0; i < BUCKET_COUNT; i++) {
+		seen += buckets[i];
+		if (seen > rank)
+			return bucketMiddle(i);
+	}
+	return bucketMiddle(BUCKET_COUNT - 1);
+}
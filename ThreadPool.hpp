@@ -0,0 +1,183 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Threads that run a loop of independent iterations together with the
+// calling thread. Every worker takes iterations from the front of its own
+// range and, when it's done, steals the back half of the largest range of
+// others.
+class ThreadPool {
+public:
+	ThreadPool() { resize(1); }
+	~ThreadPool() { resize(1); }
+
+	// Number of workers including the calling thread.
+	size_t size() const { return ranges.size(); }
+	void resize(size_t thread_count);
+
+	// Call @a func(worker, i) for every i in [0, count) and wait for all,
+	// worker is in [0, size()), 0 is the calling thread.
+	template <class FUNC>
+	void parallelFor(size_t count, FUNC&& func);
+
+private:
+	struct alignas(64) Range {
+		std::mutex mutex;
+		size_t begin = 0;
+		size_t end = 0;
+	};
+
+	bool next(size_t worker, size_t& i);
+	void run(size_t worker);
+	void work(size_t worker, size_t seen);
+
+	std::vector<std::unique_ptr<Range>> ranges;
+	std::vector<std::thread> threads;
+	// The loop of the current generation, type erased.
+	void (*call)(void *func, size_t worker, size_t i) = nullptr;
+	void *func = nullptr;
+	std::mutex mutex;
+	std::condition_variable start_cond;
+	std::condition_variable done_cond;
+	size_t generation = 0;
+	size_t running_count = 0;
+	bool stop = false;
+};
+
+void
+ThreadPool::resize(size_t thread_count)
+{
+	if (thread_count == 0)
+		thread_count = 1;
+	if (thread_count == size())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	start_cond.notify_all();
+	for (std::thread& thread : threads)
+		thread.join();
+	threads.clear();
+	stop = false;
+
+	ranges.clear();
+	for (size_t i = 0; i < thread_count; i++)
+		ranges.push_back(std::make_unique<Range>());
+	for (size_t i = 1; i < thread_count; i++)
+		threads.emplace_back(&ThreadPool::work, this, i, generation);
+}
+
+template <class FUNC>
+void
+ThreadPool::parallelFor(size_t count, FUNC&& func_)
+{
+	size_t n = size();
+	if (n == 1 || count < 2) {
+		for (size_t i = 0; i < count; i++)
+			func_(size_t(0), i);
+		return;
+	}
+
+	for (size_t w = 0; w < n; w++) {
+		ranges[w]->begin = count * w / n;
+		ranges[w]->end = count * (w + 1) / n;
+	}
+	call = [](void *f, size_t worker, size_t i) {
+		(*static_cast<std::remove_reference_t<FUNC> *>(f))(worker, i);
+	};
+	func = &func_;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		generation++;
+		running_count = n - 1;
+	}
+	start_cond.notify_all();
+	run(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	done_cond.wait(lock, [this] { return running_count == 0; });
+}
+
+bool
+ThreadPool::next(size_t worker, size_t& i)
+{
+	Range& own = *ranges[worker];
+	{
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (own.begin < own.end) {
+			i = own.begin++;
+			return true;
+		}
+	}
+	while (true) {
+		size_t victim = worker;
+		size_t victim_size = 0;
+		for (size_t w = 0; w < size(); w++) {
+			Range& r = *ranges[w];
+			std::lock_guard<std::mutex> lock(r.mutex);
+			if (r.end - r.begin > victim_size) {
+				victim = w;
+				victim_size = r.end - r.begin;
+			}
+		}
+		if (victim_size == 0)
+			return false;
+
+		Range& r = *ranges[victim];
+		size_t begin, end;
+		{
+			std::lock_guard<std::mutex> lock(r.mutex);
+			if (r.begin == r.end)
+				continue;
+			end = r.end;
+			begin = r.end - (r.end - r.begin + 1) / 2;
+			r.end = begin;
+		}
+		std::lock_guard<std::mutex> lock(own.mutex);
+		own.begin = begin + 1;
+		own.end = end;
+		i = begin;
+		return true;
+	}
+}
+
+void
+ThreadPool::run(size_t worker)
+{
+	size_t i;
+	while (next(worker, i))
+		call(func, worker, i);
+}
+
+void
+ThreadPool::work(size_t worker, size_t seen)
+{
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start_cond.wait(lock, [this, seen] {
+				return stop || generation != seen;
+			});
+			if (stop)
+				return;
+			seen = generation;
+		}
+		run(worker);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running_count--;
+		}
+		done_cond.notify_one();
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <cstddef>
+
+#include <Wire.hpp>
+
+struct TrafficCounters {
+	size_t bytes[MSG_TYPE_COUNT] = {};
+	size_t count[MSG_TYPE_COUNT] = {};
+
+	void add(Msg_t type, size_t size)
+	{
+		bytes[type] += size;
+		count[type]++;
+	}
+
+	size_t totalBytes() const
+	{
+		size_t res = 0;
+		for (size_t b : bytes)
+			res += b;
+		return res;
+	}
+
+	size_t totalCount() const
+	{
+		size_t res = 0;
+		for (size_t c : count)
+			res += c;
+		return res;
+	}
+
+	TrafficCounters operator-(const TrafficCounters& a) const
+	{
+		TrafficCounters res;
+		for (size_t i = 0; i < MSG_TYPE_COUNT; i++) {
+			res.bytes[i] = bytes[i] - a.bytes[i];
+			res.count[i] = count[i] - a.count[i];
+		}
+		return res;
+	}
+};
+
+// Cluster-wide traffic totals.
+class Traffic {
+public:
+	static void sent(Msg_t type, size_t size) { instance().sent_total.add(type, size); }
+	// Message has arrived to a node that doesn't exist anymore.
+	static void wasted(Msg_t type, size_t size) { instance().wasted_total.add(type, size); }
+	static void crossDc(Msg_t type, size_t size) { instance().cross_dc_total.add(type, size); }
+	static const TrafficCounters& getSent() { return instance().sent_total; }
+	static const TrafficCounters& getWasted() { return instance().wasted_total; }
+	static const TrafficCounters& getCrossDc() { return instance().cross_dc_total; }
+
+	Traffic(const Traffic&) = delete;
+	Traffic& operator=(const Traffic&) = delete;
+private:
+	Traffic() = default;
+	static Traffic& instance();
+
+	TrafficCounters sent_total;
+	TrafficCounters wasted_total;
+	TrafficCounters cross_dc_total;
+};
+
+Traffic&
+Traffic::instance()
+{
+	static Traffic inst;
+	return inst;
+}
@@ -10,7 +10,6 @@
 #include <cstdlib>
 #include <cmath>
 #include <numeric>
-#include <unordered_set>
 #include <vector>
 
 #define PI 3.14159265358979323846
@@ -108,60 +107,3 @@ void updMax(T& t, const U& u)
 	if (t < u)
 		t = u;
 }
-
-template <class NODE_ID>
-struct GraphScanResult {
-	size_t max_hops = 0;
-	double avg_hops = 0;
-	double max_latency = 0;
-	double avg_latency = 0;
-	size_t far_node_count = 0;
-	std::vector<NODE_ID> inaccessible_nodes;
-};
-
-template <class NODE_ID, class ALL_NODES_MAP, class JUMP_F>
-GraphScanResult<NODE_ID> scanGraph(NODE_ID origin, const ALL_NODES_MAP& all,
-				   JUMP_F&& jump)
-{
-	std::unordered_set<NODE_ID> visited;
-	std::unordered_map<NODE_ID, double> wave1, wave2;
-	visited.insert(origin);
-	wave1.emplace(origin, 0);
-	GraphScanResult<NODE_ID> res;
-	size_t avg_count = 1;
-	while (true) {
-		for (auto [node_id, cur_lat] : wave1) {
-			const auto& edges = jump(node_id);
-			for (const auto& [peer_id, next_lat] : edges) {
-				if (visited.count(peer_id) != 0)
-					continue;
-				double lat = cur_lat + next_lat;
-				auto itr = wave2.find(peer_id);
-				if (itr == wave2.end() || itr->second > lat)
-					wave2.emplace(peer_id, lat);
-			}
-		}
-		if (wave2.empty())
-			break;
-		res.max_hops++;
-		for (auto [node_id, lat] : wave2) {
-			res.avg_hops += res.max_hops;
-			res.avg_latency += lat;
-			avg_count++;
-			if (res.max_hops > 2)
-				res.far_node_count++;
-			if (res.max_latency < lat)
-				res.max_latency = lat;
-			visited.insert(node_id);
-		}
-		std::swap(wave1, wave2);
-		wave2.clear();
-	}
-	for (const auto& [node_id, thing] : all) {
-		if (visited.count(node_id) == 0)
-			res.inaccessible_nodes.push_back(node_id);
-	}
-	res.avg_hops /= avg_count;
-	res.avg_latency /= avg_count;
-	return res;
-}
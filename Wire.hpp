@@ -0,0 +1,209 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023, Aleksandr Lyapunov
+ */
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <Constants.hpp>
+#include <Types.hpp>
+
+// Types of messages that travel between nodes.
+// Every message starts with a one byte type, then its fields follow as
+// varints (see wireMsgSize of each message). Only knowledge is actually
+// encoded (see encodeKnowledge), other messages are accounted by size:
+// wireSize lists every field the receiver reads, including the sender's
+// id unless it is known from the connection the message refers to.
+enum Msg_t {
+	MSG_CONNECT,
+	MSG_CONNECT_ACCEPT,
+	MSG_CONNECT_ACK,
+	MSG_CONNECT_REJECT,
+	MSG_DISCONNECT,
+	MSG_FAREWELL,
+	MSG_HEARTBEAT_PING,
+	MSG_HEARTBEAT_PONG,
+	MSG_GOSSIP,
+	MSG_GOSSIP_DIGEST,
+	MSG_GOSSIP_DIGEST_REPLY,
+	MSG_GOSSIP_PULL,
+	MSG_IHAVE,
+	MSG_GRAFT,
+	MSG_PRUNE,
+	MSG_SHUFFLE,
+	MSG_TYPE_COUNT,
+};
+
+constexpr const char *MSG_NAMES[MSG_TYPE_COUNT] = {
+	"connect",
+	"connect_accept",
+	"connect_ack",
+	"connect_reject",
+	"disconnect",
+	"farewell",
+	"heartbeat_ping",
+	"heartbeat_pong",
+	"gossip",
+	"gossip_digest",
+	"gossip_digest_reply",
+	"gossip_pull",
+	"ihave",
+	"graft",
+	"prune",
+	"shuffle",
+};
+
+// Whether messages of @a type spread knowledge.
+inline bool
+isGossipMsg(Msg_t type)
+{
+	return type >= MSG_GOSSIP && type <= MSG_PRUNE;
+}
+
+inline size_t
+varintSize(uint64_t val)
+{
+	size_t res = 1;
+	while (val >= 0x80) {
+		val >>= 7;
+		res++;
+	}
+	return res;
+}
+
+inline uint64_t wireValue(uint64_t val) { return val; }
+inline uint64_t wireValue(NodeId id) { return id.rawID(); }
+inline uint64_t wireValue(ConnId id) { return id.rawID(); }
+
+// Size of a message of the given fields, including the type byte.
+template <class... FIELDS>
+size_t
+wireMsgSize(const FIELDS&... fields)
+{
+	return (1 + ... + varintSize(wireValue(fields)));
+}
+
+// Size of a length-prefixed byte string.
+inline size_t
+wireBytesSize(size_t len)
+{
+	return varintSize(len) + len;
+}
+
+inline uint64_t
+quantizeLatency(double latency)
+{
+	return uint64_t(latency / WIRE_LATENCY_QUANTUM + .5);
+}
+
+inline double
+dequantizeLatency(uint64_t q)
+{
+	return double(q * WIRE_LATENCY_QUANTUM);
+}
+
+// Signed latency-like values, such as coordinates.
+inline int64_t
+quantizeOffset(double offset)
+{
+	return int64_t(std::lround(offset / WIRE_LATENCY_QUANTUM));
+}
+
+inline double
+dequantizeOffset(int64_t q)
+{
+	return double(q) * WIRE_LATENCY_QUANTUM;
+}
+
+// Map signed values to unsigned ones so that small magnitudes stay small.
+inline uint64_t
+zigzag(int64_t val)
+{
+	return (uint64_t(val) << 1) ^ uint64_t(val >> 63);
+}
+
+inline int64_t
+unzigzag(uint64_t val)
+{
+	return int64_t(val >> 1) ^ -int64_t(val & 1);
+}
+
+class WireWriter {
+public:
+	explicit WireWriter(std::vector<uint8_t>& buf_) : buf(buf_) {}
+
+	void putVarint(uint64_t val)
+	{
+		while (val >= 0x80) {
+			buf.push_back(uint8_t(val) | 0x80);
+			val >>= 7;
+		}
+		buf.push_back(uint8_t(val));
+	}
+
+	// Reserve place for a varint length that is written later by
+	// finishLength. Lengths are limited by 2^28.
+	size_t startLength()
+	{
+		size_t pos = buf.size();
+		buf.resize(pos + 4);
+		return pos;
+	}
+
+	// Write the length of data after @a pos and compact it.
+	void finishLength(size_t pos)
+	{
+		size_t len = buf.size() - pos - 4;
+		assert(len < (1u << 28));
+		size_t len_size = varintSize(len);
+		uint8_t *p = buf.data() + pos;
+		if (len_size != 4)
+			memmove(p + len_size, p + 4, len);
+		uint64_t val = len;
+		for (size_t i = 0; i + 1 < len_size; i++, val >>= 7)
+			p[i] = uint8_t(val) | 0x80;
+		p[len_size - 1] = uint8_t(val);
+		buf.resize(pos + len_size + len);
+	}
+
+private:
+	std::vector<uint8_t>& buf;
+};
+
+class WireReader {
+public:
+	WireReader(const uint8_t *pos_, const uint8_t *end_)
+		: pos(pos_), end(end_) {}
+	explicit WireReader(const std::vector<uint8_t>& buf)
+		: pos(buf.data()), end(buf.data() + buf.size()) {}
+
+	bool more() const { return pos < end; }
+
+	uint64_t getVarint()
+	{
+		uint64_t res = 0;
+		for (unsigned shift = 0; ; shift += 7) {
+			assert(pos < end);
+			uint8_t b = *pos++;
+			res |= uint64_t(b & 0x7f) << shift;
+			if (b < 0x80)
+				return res;
+		}
+	}
+
+	void skip(size_t len)
+	{
+		assert(pos + len <= end);
+		pos += len;
+	}
+
+private:
+	const uint8_t *pos;
+	const uint8_t *end;
+};